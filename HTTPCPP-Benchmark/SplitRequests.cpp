@@ -0,0 +1,114 @@
+#include "SplitRequests.h"
+#include "Socket.h"
+#include "HttpRequest.h"
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <string_view>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#elif defined(__linux__)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#endif
+
+namespace
+{
+	constexpr std::chrono::milliseconds gap(200); //between the pieces of a request
+	constexpr std::chrono::seconds receiveTimeout(5); //what the server gives a request, far longer than the gaps
+
+	struct SplitRequest
+	{
+		std::string_view mName;
+		std::vector<std::string> mPieces;
+		std::string_view mMethod, mPath;
+		std::size_t mBodySize;
+	};
+
+	std::uint16_t getPort(const Socket &socket)
+	{
+		sockaddr_in address = {};
+		socklen_t length = sizeof(address);
+
+		if (getsockname(socket.get(), reinterpret_cast<sockaddr*>(&address), &length))
+			throw SocketException("getsockname failed");
+
+		return ntohs(address.sin_port);
+	}
+
+	void setReceiveTimeout(Socket &socket)
+	{
+		#ifdef _WIN32
+		DWORD timeout = static_cast<DWORD>(std::chrono::milliseconds(receiveTimeout).count());
+		#elif defined(__linux__)
+		timeval timeout = { static_cast<time_t>(receiveTimeout.count()), 0 };
+		#endif
+
+		socket.setSocketOption(SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	}
+
+	bool check(Socket &listener, const SplitRequest &request)
+	{
+		Socket client(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+		client.connect("127.0.0.1", getPort(listener), true);
+
+		Socket server(listener.acceptDescriptor());
+		std::thread sender([&]()
+		{
+			for (const std::string &piece : request.mPieces)
+			{
+				std::this_thread::sleep_for(gap);
+				client.send(piece.data(), piece.size());
+			}
+		});
+		bool passed = false;
+
+		setReceiveTimeout(server);
+		try
+		{
+			Http::Request parsed(server);
+
+			passed = parsed.getMethod() == request.mMethod && parsed.getResourcePath() == request.mPath && parsed.getBody().size() == request.mBodySize;
+			if (!passed)
+				std::cout << "split requests: " << request.mName << " was parsed wrong" << std::endl;
+		}
+		catch (const std::exception &e)
+		{
+			std::cout << "split requests: " << request.mName << " failed, " << e.what() << std::endl;
+		}
+
+		sender.join();
+
+		return passed;
+	}
+}
+
+bool testSplitRequests()
+{
+	std::string body(1000, 'x');
+	std::vector<SplitRequest> requests =
+	{
+		{ "header split in the request line", { "GET /sp", "lit HTTP/1.1\r\nHost: localhost\r\n\r\n" }, "GET", "/split", 0 },
+		{ "header split in its last line break", { "GET /split HTTP/1.1\r\nHost: localhost\r\n\r", "\n" }, "GET", "/split", 0 },
+		{ "header in three pieces", { "GET /split HTTP/1.1\r\n", "Host: local", "host\r\n\r\n" }, "GET", "/split", 0 },
+		{ "body after the header", { "POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Length: 1000\r\n\r\n", body }, "POST", "/upload", body.size() },
+		{ "body in pieces", { "POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Length: 1000\r\n\r\n" + body.substr(0, 100), body.substr(100, 400), body.substr(500) }, "POST", "/upload", body.size() }
+	};
+	Socket listener(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	bool passed = true;
+
+	listener.bind("127.0.0.1", 0, true);
+	listener.listen(static_cast<int>(requests.size()));
+
+	for (const SplitRequest &request : requests)
+		passed = check(listener, request) && passed;
+
+	if (passed)
+		std::cout << "split requests: " << requests.size() << " requests sent in pieces " << gap.count() << " ms apart, all parsed" << std::endl;
+
+	return passed;
+}
@@ -0,0 +1,8 @@
+#ifndef __SPLITREQUESTS__
+#define __SPLITREQUESTS__
+
+//Sends requests over loopback in pieces with pauses between them, the way slow clients and real networks deliver them, and
+//parses each with Http::Request. False if one was cut short or rejected instead of waited for.
+bool testSplitRequests();
+
+#endif
@@ -0,0 +1,166 @@
+#include "ThreadPool.h"
+#include "WakeupStress.h"
+#include "SplitRequests.h"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <queue>
+#include <vector>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <algorithm>
+
+namespace
+{
+	//the mutex and condition variable pool ThreadPool used to be, with addTask actually taking the lock
+	class LegacyThreadPool
+	{
+		std::atomic<bool> mWorkFlag;
+		std::vector<std::thread> mWorkers;
+		std::queue<std::function<void()>> mWorkQueue;
+		std::mutex mWorkMutex;
+		std::condition_variable mWorkAvailable, mNoWork;
+		unsigned mBusy;
+
+		void workerProcedure()
+		{
+			while (mWorkFlag.load())
+			{
+				std::unique_lock<std::mutex> lck(mWorkMutex);
+
+				if (!mWorkQueue.empty())
+				{
+					auto task = mWorkQueue.front();
+					mWorkQueue.pop();
+
+					++mBusy;
+					lck.unlock();
+					task();
+					lck.lock();
+					--mBusy;
+
+					if (mWorkQueue.empty())
+						mNoWork.notify_all();
+				}
+				else
+					mWorkAvailable.wait(lck, [this]() { return !mWorkQueue.empty() || !mWorkFlag.load(); });
+			}
+		}
+	public:
+		LegacyThreadPool(std::size_t workerCount)
+			:mWorkFlag(true)
+			,mBusy(0)
+		{
+			for (std::size_t i = 0; i < workerCount; ++i)
+				mWorkers.emplace_back(&LegacyThreadPool::workerProcedure, this);
+		}
+
+		~LegacyThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lck(mWorkMutex);
+				mWorkFlag.store(false);
+			}
+			mWorkAvailable.notify_all();
+			for (auto &worker : mWorkers)
+				worker.join();
+		}
+
+		void addTask(const std::function<void()> &task)
+		{
+			std::lock_guard<std::mutex> lck(mWorkMutex);
+			mWorkQueue.emplace(task);
+			mWorkAvailable.notify_one();
+		}
+
+		void waitForTasks()
+		{
+			std::unique_lock<std::mutex> lck(mWorkMutex);
+			mNoWork.wait(lck, [this]() { return mWorkQueue.empty() && !mBusy; });
+		}
+	};
+
+	//keeps the compiler from optimizing the work away
+	std::atomic<std::uint64_t> sink;
+
+	void work(unsigned iterations)
+	{
+		std::uint64_t value = iterations;
+
+		for (unsigned i = 0; i < iterations; ++i)
+			value = value * 6364136223846793005ull + 1442695040888963407ull;
+		sink.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	//one thread submits everything, like the accept loop does
+	template<typename Pool>
+	double singleProducer(std::size_t workers, std::size_t tasks, unsigned iterations)
+	{
+		Pool pool(workers);
+		auto start = std::chrono::steady_clock::now();
+
+		for (std::size_t i = 0; i < tasks; ++i)
+			pool.addTask([iterations]() { work(iterations); });
+		pool.waitForTasks();
+
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	//tasks submit more tasks, the case per-worker deques are meant for
+	template<typename Pool>
+	double fanOut(std::size_t workers, std::size_t tasks, unsigned iterations)
+	{
+		constexpr std::size_t children = 16;
+		Pool pool(workers);
+		auto start = std::chrono::steady_clock::now();
+
+		for (std::size_t i = 0; i < tasks / children; ++i)
+		{
+			pool.addTask([&pool, iterations]()
+			{
+				for (std::size_t j = 1; j < children; ++j)
+					pool.addTask([iterations]() { work(iterations); });
+				work(iterations);
+			});
+		}
+		pool.waitForTasks();
+
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void report(std::string_view scenario, std::size_t workers, std::size_t tasks, double legacy, double current)
+	{
+		std::cout << std::left << std::setw(24) << scenario << std::right << std::setw(4) << workers << " workers"
+			<< std::setw(14) << static_cast<std::uint64_t>(tasks / legacy) << " tasks/s legacy"
+			<< std::setw(14) << static_cast<std::uint64_t>(tasks / current) << " tasks/s current"
+			<< std::setw(8) << std::fixed << std::setprecision(2) << legacy / current << 'x' << std::endl;
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	std::size_t tasks = argc > 1 ? std::stoull(argv[1]) : 1000000;
+	unsigned hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+
+	for (std::size_t workers : { std::size_t(1), std::size_t(hardwareThreads), std::size_t(hardwareThreads) * 2 })
+	{
+		for (unsigned iterations : { 0u, 1000u })
+		{
+			std::string name = (iterations ? "short tasks" : "empty tasks");
+
+			report(name, workers, tasks, singleProducer<LegacyThreadPool>(workers, tasks, iterations), singleProducer<ThreadPool>(workers, tasks, iterations));
+			report(name + ", fan-out", workers, tasks, fanOut<LegacyThreadPool>(workers, tasks, iterations), fanOut<ThreadPool>(workers, tasks, iterations));
+		}
+	}
+
+	bool passed = stressWakeup(std::max(4u, hardwareThreads), 200000);
+
+	passed = testSplitRequests() && passed;
+
+	return passed ? 0 : 1;
+}
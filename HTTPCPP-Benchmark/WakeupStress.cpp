@@ -0,0 +1,97 @@
+#include "WakeupStress.h"
+#include "Wakeup.h"
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#elif defined(__linux__)
+#include <poll.h>
+#endif
+
+namespace
+{
+	int pollOne(DescriptorType descriptor, int timeout)
+	{
+		#ifdef _WIN32
+		WSAPOLLFD entry = { .fd = descriptor, .events = POLLIN, .revents = 0 };
+
+		return WSAPoll(&entry, 1, timeout);
+		#elif defined(__linux__)
+		pollfd entry = { .fd = descriptor, .events = POLLIN, .revents = 0 };
+
+		return poll(&entry, 1, timeout);
+		#endif
+	}
+}
+
+bool stressWakeup(std::size_t producers, std::size_t parksPerProducer)
+{
+	constexpr int timeout = 1000; //far longer than any notify takes to show up
+	Wakeup wakeup;
+	std::mutex mutex;
+	std::vector<std::size_t> parked;
+	std::atomic<bool> lost = false;
+	std::size_t taken = 0, total = producers * parksPerProducer, wakeups = 0;
+	std::vector<std::thread> threads;
+
+	for (std::size_t i = 0; i < producers; ++i)
+	{
+		threads.emplace_back([&, i]()
+		{
+			for (std::size_t j = 0; j < parksPerProducer && !lost.load(std::memory_order_relaxed); ++j)
+			{
+				{
+					std::lock_guard<std::mutex> lck(mutex);
+					parked.push_back(i);
+				}
+				wakeup.notify();
+				if (j % 64 == 0)
+					std::this_thread::yield(); //lets the poller drain in between, so notifies land in every part of clear
+			}
+		});
+	}
+
+	while (taken < total)
+	{
+		int result = pollOne(wakeup.get(), timeout);
+
+		if (result < 0)
+		{
+			std::cout << "parked connections stress: poll failed" << std::endl;
+			lost.store(true);
+			break;
+		}
+
+		if (!result)
+		{
+			std::lock_guard<std::mutex> lck(mutex);
+
+			if (!parked.empty())
+			{
+				std::cout << "parked connections stress: lost a wakeup, " << parked.size() << " connections left parked" << std::endl;
+				lost.store(true);
+				break;
+			}
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lck(mutex);
+
+		wakeup.clear();
+		taken += parked.size();
+		parked.clear();
+		++wakeups;
+	}
+
+	for (auto &thread : threads)
+		thread.join();
+
+	if (!lost.load())
+		std::cout << "parked connections stress: " << total << " parks from " << producers << " threads in " << wakeups << " wakeups, none lost" << std::endl;
+
+	return !lost.load();
+}
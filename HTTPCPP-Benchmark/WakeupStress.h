@@ -0,0 +1,10 @@
+#ifndef __WAKEUPSTRESS__
+#define __WAKEUPSTRESS__
+#include <cstddef>
+
+//Parks connections from many threads at once the way Server::Impl::park does, queueing them under a mutex and notifying a
+//Wakeup, while one thread polls and takes them the way the server thread does. False if a wakeup was lost, which shows
+//as parked connections that poll keeps timing out on.
+bool stressWakeup(std::size_t producers, std::size_t parksPerProducer);
+
+#endif
@@ -1,42 +1,18 @@
 #include <iostream>
 #include <string>
-#include <fstream>
 #include <regex>
 #include <charconv>
-#include <filesystem>
 #include "HttpResponse.h"
 #include "HttpRequest.h"
+#include "HttpStaticFileHandler.h"
 
 std::vector<std::string> getFilesWithExtension(std::string_view, std::string_view);
-std::streampos getFileSize(const std::string_view&);
-std::streampos getFileSize(std::ifstream&);
-std::vector<std::uint8_t> loadFile(const std::string_view&);
-std::vector<std::uint8_t> loadFile(const std::string_view&, std::streampos, std::streampos);
 
 using Http::Response;
 using Http::Request;
 
 namespace
 {
-	void sendNotAllowed(Request &req, Response &resp, const std::string &allowedMethods)
-	{
-		resp.setStatusCode(405);
-		resp.setField(Response::HeaderField::Connection, "close");
-		resp.setField(Response::HeaderField::CacheControl, "no-store");
-		resp.setField(Response::HeaderField::Allow, allowedMethods);
-		resp.send();
-	}
-
-	void setKeepAlive(Request &request, Response &response)
-	{
-		auto connectionHeader = request.getField("connection");
-
-		if (connectionHeader && connectionHeader.value() == "keep-alive")
-			response.setField(Response::HeaderField::Connection, "keep-alive");
-		else
-			response.setField(Response::HeaderField::Connection, "close");
-	}
-
 	std::string removeEscapeSequences(std::string string) //string would have to be copied anyway, so pass by value
 	{
 		static std::regex escapeFormat("%([0-9A-F]{2})");
@@ -71,46 +47,23 @@ void redirect(Request &req, Response &resp)
 	resp.setField(Response::HeaderField::ContentType, "text/html");
 	resp.setField(Response::HeaderField::CacheControl, "no-store");
 
-	setKeepAlive(req, resp);
-
 	resp.setField(Response::HeaderField::Location, "/images");
 	resp.send();
 }
 
-void favicon(Request &req, Response &resp)
+void health(Request &req, Response &resp)
 {
-	if (req.getMethod() != "GET")
-	{
-		sendNotAllowed(req, resp, "GET");
-		return;
-	}
-
-	auto fileBytes = loadFile("favicon.ico");
-
-	if (!fileBytes.empty())
-	{
-		resp.setStatusCode(200);
-		resp.setField(Response::HeaderField::ContentType, "image/x-icon");
-		resp.setField(Response::HeaderField::ContentLength, std::to_string(fileBytes.size()));
-
-		setKeepAlive(req, resp);
-
-		resp.setBody(fileBytes);
-	}
-	else
-		resp.setStatusCode(404);
+	resp.setStatusCode(200);
+	resp.setField(Response::HeaderField::ContentType, "text/plain");
+	resp.setField(Response::HeaderField::ContentLength, "2");
+	resp.setField(Response::HeaderField::CacheControl, "no-store");
 
+	resp.setBody("OK");
 	resp.send();
 }
 
 void list(Request &req, Response &resp, std::string_view endpoint, std::string_view extension)
 {
-	if (req.getMethod() != "GET")
-	{
-		sendNotAllowed(req, resp, "GET");
-		return;
-	}
-
 	std::string mBody;
 
 	for (const auto &name : getFilesWithExtension(".", /*".jpg"*/extension))
@@ -129,8 +82,6 @@ void list(Request &req, Response &resp, std::string_view endpoint, std::string_v
 	resp.setField(Response::HeaderField::ContentLength, std::to_string(mBody.size()));
 	resp.setField(Response::HeaderField::CacheControl, "no-store");
 
-	setKeepAlive(req, resp);
-
 	resp.setBody(mBody);
 
 	resp.send();
@@ -138,109 +89,28 @@ void list(Request &req, Response &resp, std::string_view endpoint, std::string_v
 
 void image(Request &req, Response &resp) //?name=<image file name>
 {
-	if (req.getMethod() != "GET")
-	{
-		sendNotAllowed(req, resp, "GET");
-		return;
-	}
-
 	auto name = req.getRequestStringValue("name");
 
 	if (name.has_value() && name.value().find_first_of("\\/") == std::string::npos)
-	{
-		auto fileBytes = loadFile(removeEscapeSequences(static_cast<std::string>(name.value())));
-
-		if (!fileBytes.empty())
-		{
-			resp.setStatusCode(200);
-			resp.setField(Response::HeaderField::ContentLength, std::to_string(fileBytes.size()));
-			resp.setField(Response::HeaderField::ContentType, "image/jpeg");
-			resp.setField(Response::HeaderField::CacheControl, "no-store");
-
-			setKeepAlive(req, resp);
-
-			resp.setBody(fileBytes);
-		}
-		else
-		{
-			resp.setStatusCode(422);
-			resp.setField(Response::HeaderField::Connection, "close");
-		}
-	}
+		Http::StaticFileHandler::serve(req, resp, removeEscapeSequences(static_cast<std::string>(name.value())), "no-cache");
 	else
 	{
 		resp.setStatusCode(422);
 		resp.setField(Response::HeaderField::Connection, "close");
+		resp.send();
 	}
-
-	resp.send();
 }
 
 void video(Request &req, Response &resp) //?name=<video file name>
 {
-	if (req.getMethod() != "GET")
-	{
-		sendNotAllowed(req, resp, "GET");
-		return;
-	}
-
 	auto name = req.getRequestStringValue("name");
 
 	if (name && name.value().find_first_of("\\/") == std::string::npos)
-	{
-		std::string convertedName{ removeEscapeSequences(static_cast<std::string>(name.value())) };
-		static std::regex rangeFormat("bytes=([[:digit:]]+)-([[:digit:]]*)");
-		std::cmatch results;
-		std::vector<std::uint8_t> chunk;
-		std::uint64_t rangeBegin = 0, rangeEnd = 0, fileSize = std::filesystem::directory_entry{ convertedName }.file_size();
-		auto range = req.getField(Request::HeaderField::Range);
-
-		resp.setField(Response::HeaderField::ContentType, "video/mp4");
-		resp.setField(Response::HeaderField::CacheControl, "no-store");
-		resp.setField(Response::HeaderField::AcceptRanges, "bytes");
-
-		setKeepAlive(req, resp);
-
-		if (range && std::regex_match(range.value().data(), results, rangeFormat))
-		{
-			rangeBegin = std::stoull(results[1]);
-			rangeEnd = (results[2].str().empty() ? std::min(rangeBegin + 1024 * 1024, fileSize) : std::stoull(results[2]));
-
-			if (rangeBegin < rangeEnd && rangeEnd <= fileSize)
-			{
-				chunk = loadFile(convertedName, rangeBegin, rangeEnd);
-
-				resp.setField(Response::HeaderField::ContentRange, "bytes " + std::to_string(rangeBegin) + '-' + std::to_string(rangeEnd - 1) + '/' + std::to_string(fileSize));
-				resp.setField(Response::HeaderField::ContentLength, std::to_string(chunk.size()));
-				resp.setBody(chunk);
-				resp.setStatusCode(206);
-			}
-			else
-				resp.setStatusCode(416);
-		}
-		else
-		{
-			std::uint64_t sent = 0ull;
-
-			resp.setStatusCode(200);
-			resp.setField(Response::HeaderField::ContentLength, std::to_string(fileSize));
-			resp.sendHeaders();
-
-			while (sent < fileSize)
-			{
-				chunk = loadFile(convertedName, sent, std::min(fileSize, sent + 1024 * 1024 * 4));
-				resp.sendBytes(chunk);
-				sent += chunk.size();
-			}
-
-			return;
-		}
-	}
+		Http::StaticFileHandler::serve(req, resp, removeEscapeSequences(static_cast<std::string>(name.value())), "no-cache");
 	else
 	{
 		resp.setStatusCode(422);
 		resp.setField("connection", "close");
+		resp.send();
 	}
-
-	resp.send();
 }
\ No newline at end of file
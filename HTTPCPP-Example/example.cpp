@@ -1,13 +1,17 @@
 #include "HttpServer.h"
+#include "HttpStaticFileHandler.h"
+#include "HttpRouteTable.h"
+#include "HttpMiddleware.h"
 #include <iostream>
-#include <fstream>
 #include <filesystem>
 
 void redirect(Http::Request&, Http::Response&);
-void favicon(Http::Request&, Http::Response&);
 void list(Http::Request&, Http::Response&, std::string_view endpoint, std::string_view extension);
 void image(Http::Request&, Http::Response&);
 void video(Http::Request &req, Http::Response &resp);
+void health(Http::Request&, Http::Response&);
+
+using StaticRoutes = Http::RouteTable<Http::StaticRoute<"/health", health>>; //matched before the routes below, without a tree walk
 
 std::vector<std::string> filenames(const std::string_view &directory)
 {
@@ -42,51 +46,6 @@ std::vector<std::string> getFilesWithExtension(std::string_view directory, std::
 	return result;
 }
 
-std::vector<std::uint8_t> loadFile(const std::string_view &fileName)
-{
-	std::vector<std::uint8_t> result;
-	std::ifstream file(fileName.data(), std::ios::binary);
-
-	if (file.is_open())
-	{
-		size_t size = std::filesystem::directory_entry{ fileName }.file_size();
-		std::streamsize bytesRead = 0;
-		result.resize(size);
-
-		while (file) {
-			file.read((char*)(result.data()) + bytesRead, 512);
-			bytesRead += file.gcount();
-		}
-	}
-
-	return result;
-}
-
-//range overflows file
-std::vector<std::uint8_t> loadFile(const std::string_view &fileName, std::streampos first, std::streampos last)
-{
-	std::vector<std::uint8_t> result;
-
-	if (first < last)
-	{
-		std::ifstream file(fileName.data(), std::ios::binary);
-
-		if (file.is_open())
-		{
-			std::streamsize bytesRead = 0;
-			result.resize(last - first);
-			file.seekg(first);
-
-			while (bytesRead < last - first) {
-				file.read((char*)(result.data()) + bytesRead, last - first - bytesRead);
-				bytesRead += file.gcount();
-			}
-		}
-	}
-
-	return result;
-}
-
 void logger(std::string_view msg)
 {
 	std::cout << "Endpoint logger: " << msg << std::endl;
@@ -106,14 +65,31 @@ int main()
 	try
 	{
 		std::string input;
-		Http::Server sv(80, 443, 50, "MY", "localhost"); //You'll need a server authentication certificate named 'localhost' in the personal certificate store for this to work.
-
-		sv.setResourceCallback("/images", std::bind(list, std::placeholders::_1, std::placeholders::_2, "image", ".jpg"));
-		sv.setResourceCallback("/videos", std::bind(list, std::placeholders::_1, std::placeholders::_2, "video", ".mp4"));
-		sv.setResourceCallback("/", redirect);
-		sv.setResourceCallback("/favicon.ico", favicon);
-		sv.setResourceCallback("/image", image);
-		sv.setResourceCallback("/video", video);
+		Http::Server::Listeners inherited = Http::Server::getActivationListeners(); //started by systemd socket activation, the listeners are already bound
+		//You'll need a server authentication certificate named 'localhost' in the personal certificate store for this to work.
+		Http::Server sv = inherited.mSocket != -1 ? Http::Server(inherited, 50, "MY", "localhost") : Http::Server(80, 443, 50, "MY", "localhost");
+		Http::Server::ResponseCachePolicy listingCache;
+		Http::Server::ExecutorConfiguration fileTransfers;
+
+		listingCache.mTimeToLive = std::chrono::seconds(1);
+		listingCache.mStaleWhileRevalidate = std::chrono::seconds(5); //listing a directory on every request is wasteful, a few seconds old listing is fine
+
+		sv.setResourceCallback("/images", Http::Request::Method::Get, std::bind(list, std::placeholders::_1, std::placeholders::_2, "image", ".jpg"));
+		sv.setResourceCallback("/videos", Http::Request::Method::Get, std::bind(list, std::placeholders::_1, std::placeholders::_2, "video", ".mp4"));
+		fileTransfers.mWorkerCount = 4; //downloads can't take the workers serving everything else
+
+		sv.setResponseCache("/images", listingCache);
+		sv.setResponseCache("/videos", listingCache);
+		sv.setResourceCallback("/", Http::Request::Method::Get, redirect);
+		sv.setResourceCallback("/favicon.ico", Http::Request::Method::Get, Http::StaticFileHandler(".", "/"));
+		sv.setResourceCallback("/image", Http::Request::Method::Get, image);
+		sv.setResourceCallback("/video", Http::Request::Method::Get, video);
+		sv.setExecutor("files", fileTransfers);
+		sv.setRouteExecutor("/image", "files");
+		sv.setRouteExecutor("/video", "files");
+		sv.setRouteExecutor("/", Http::Server::inlineExecutor);
+		sv.setRouteTable<StaticRoutes>();
+		sv.setMiddleware(Http::MiddlewareChain(Http::KeepAlive())); //handlers only set Connection when they want to close it
 		sv.setEndpointLogger(logger);
 		sv.setErrorLogger(errorLogger);
 		sv.start();
@@ -130,6 +106,8 @@ int main()
 				#endif
 			}
 		} while (input != "exit" && cin);
+
+		sv.drain(std::chrono::seconds(5)); //in flight requests finish, idle keep-alive connections get 5 seconds to send another one
 	}
 	catch (const std::runtime_error &e)
 	{
@@ -0,0 +1,65 @@
+#ifndef __HTTPMIDDLEWARE__
+#define __HTTPMIDDLEWARE__
+#include <tuple>
+#include <utility>
+#include <cstddef>
+#include <cctype>
+#include <algorithm>
+#include <string_view>
+#include "HttpServer.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+namespace Http
+{
+	//Middlewares composed into a single callable when the chain is built, ready for Server::setMiddleware:
+	//	server.setMiddleware(Http::MiddlewareChain(Http::KeepAlive(), [](Http::Request &request, Http::Response &response, auto &&next)
+	//	{
+	//		if (!request.getField(Http::Request::HeaderField::Authorization))
+	//			sendUnauthorized(response); //short-circuits, the request never reaches its route
+	//		else
+	//			next(request, response);
+	//	}));
+	//Each middleware gets the next one as a concrete type, so calls are inlined and nothing is allocated per request.
+	//Middlewares are shared by all worker threads and must be callable as const.
+	template<typename... Middlewares>
+	class MiddlewareChain
+	{
+		std::tuple<Middlewares...> mMiddlewares;
+
+		template<std::size_t index, typename Last>
+		void invoke(Request &request, Response &response, const Last &last) const
+		{
+			if constexpr (index == sizeof...(Middlewares))
+				last(request, response);
+			else
+				std::get<index>(mMiddlewares)(request, response, [this, &last](Request &request, Response &response) { invoke<index + 1>(request, response, last); });
+		}
+	public:
+		MiddlewareChain(Middlewares... middlewares)
+			:mMiddlewares(std::move(middlewares)...)
+		{}
+
+		void operator()(Request &request, Response &response, Next next) const
+		{
+			invoke<0>(request, response, next);
+		}
+	};
+
+	//answers keep-alive with keep-alive and anything else with close, handlers can still override it
+	struct KeepAlive
+	{
+		template<typename NextMiddleware>
+		void operator()(Request &request, Response &response, NextMiddleware &&next) const
+		{
+			auto connectionHeader = request.getField(Request::HeaderField::Connection);
+			constexpr std::string_view keepAlive = "keep-alive";
+			bool keep = connectionHeader && std::equal(connectionHeader->begin(), connectionHeader->end(), keepAlive.begin(), keepAlive.end(), [](char lhs, char rhs) { return std::tolower(static_cast<unsigned char>(lhs)) == rhs; });
+
+			response.setField(Response::HeaderField::Connection, keep ? "keep-alive" : "close");
+			next(request, response);
+		}
+	};
+}
+
+#endif
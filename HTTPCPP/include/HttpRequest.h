@@ -6,6 +6,9 @@
 #include <cstdint>
 #include <vector>
 #include <memory>
+#include <memory_resource>
+#include <utility>
+#include <span>
 
 class Socket;
 
@@ -15,22 +18,36 @@ namespace Http
 	{
 		class Impl;
 		Impl *mThis;
+
+		friend class Server;
+		//everything the request allocates comes from resource, which has to outlive it
+		Request(Socket &socket, std::pmr::memory_resource *resource);
+		void setPathParameters(std::span<const std::pair<std::string_view, std::string_view>> parameters);
 	public:
 		enum class HeaderField : std::size_t;
+		enum class Method : std::uint8_t;
 
-		Request(std::shared_ptr<Socket>);
+		//reads the request from socket, which is only borrowed and has to outlive the request
+		Request(Socket &socket);
 		~Request() noexcept;
 		Request(Request&&) noexcept;
 		Request& operator=(Request&&) noexcept;
 
 		std::string_view getMethod();
+		//parsed along with the request line, Method::Other for extension methods, whose text is still available through getMethod
+		Method getMethodId();
 		std::string_view getResourcePath();
 		std::string_view getVersion();
 		std::optional<std::string_view> getField(HeaderField field);
 		std::optional<std::string_view> getField(std::string_view field);
 		std::optional<std::string_view> getRequestStringValue(std::string_view key);
+		//value of a {name} segment of the route that matched, "*" for the wildcard tail
+		std::optional<std::string_view> getPathParameter(std::string_view name);
 		std::vector<std::string_view> getRequestStringKeys();
-		const std::vector<std::uint8_t>& getBody();
+		std::span<const std::uint8_t> getBody();
+
+		//nullptr for Method::Other
+		static const char* getMethodText(Method method) noexcept;
 	};
 
 	using RequestException = std::runtime_error;
@@ -78,6 +95,20 @@ namespace Http
 		Warning, //last field
 		Invalid
 	};
+
+	enum class Request::Method : std::uint8_t //https://www.rfc-editor.org/rfc/rfc9110#section-9
+	{
+		Get,
+		Head,
+		Post,
+		Put,
+		Delete,
+		Connect,
+		Options,
+		Trace,
+		Patch, //last method
+		Other
+	};
 }
 
 #endif
\ No newline at end of file
@@ -2,11 +2,15 @@
 #define __HTTPRESPONSE__
 #include "ExportMacros.h"
 #include <vector>
+#include <string>
 #include <string_view>
 #include <optional>
 #include <memory>
+#include <memory_resource>
+#include <span>
 
 class Socket;
+class File;
 
 namespace Http
 {
@@ -14,9 +18,21 @@ namespace Http
 	{
 		class Impl;
 		Impl *mThis;
+
+		friend class Server;
+		friend class StaticFileHandler;
+		//everything the response allocates comes from resource, which has to outlive it
+		Response(Socket &socket, std::pmr::memory_resource *resource);
+		//used for HEAD requests, send only sends headers and sendBytes and sendFile do nothing
+		void suppressBody() noexcept;
+		//everything sent is appended to buffer instead, without the Connection field. Used to fill response caches.
+		void setCaptureBuffer(std::string *buffer) noexcept;
+		//sendFile from a file that's already open, so the headers and every range describe and send the same file even if the one at its path is replaced meanwhile
+		void sendFile(const File &file, std::uint64_t offset, std::uint64_t count);
 	public:
 		enum class HeaderField;
-		Response(std::shared_ptr<Socket>);
+		//socket is only borrowed and has to outlive the response
+		Response(Socket &socket);
 		~Response() noexcept;
 		Response(Response&&) noexcept;
 		Response& operator=(Response&&) noexcept;
@@ -30,6 +46,9 @@ namespace Http
 		std::optional<std::string_view> getField(std::string_view field);
 		void sendHeaders();
 		void sendBytes(const std::vector<std::uint8_t> &bytes);
+		void sendBytes(std::span<const std::uint8_t> bytes);
+		//sends count bytes of the file at path, starting at offset, straight from the file to the socket. Headers must be sent first.
+		void sendFile(std::string_view path, std::uint64_t offset, std::uint64_t count);
 		void send();
 	};
 
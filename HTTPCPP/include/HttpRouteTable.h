@@ -0,0 +1,102 @@
+#ifndef __HTTPROUTETABLE__
+#define __HTTPROUTETABLE__
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <algorithm>
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+
+namespace Http
+{
+	//bit of method in the method sets sendMethodNotAllowed takes
+	constexpr std::uint32_t getMethodBit(Request::Method method) noexcept
+	{
+		return 1u << static_cast<unsigned>(method);
+	}
+
+	//the 405 of route tables, routes registered with Server::setResourceCallback and StaticFileHandler, with an Allow field listing methods.
+	//The connection stays open if the client asked for keep-alive.
+	EXPORT void sendMethodNotAllowed(Request &request, Response &response, std::uint32_t methods);
+
+	//string literal usable as a template argument
+	template<std::size_t N>
+	struct FixedString
+	{
+		char mText[N];
+
+		constexpr FixedString(const char (&text)[N])
+		{
+			std::copy_n(text, N, mText);
+		}
+
+		constexpr std::string_view view() const noexcept
+		{
+			return std::string_view(mText, N - 1);
+		}
+	};
+
+	//route of a RouteTable, handler is a function with the signature of Server::HandlerCallback
+	template<FixedString Path, auto Handler, Request::Method Method = Request::Method::Get>
+	struct StaticRoute
+	{
+		static_assert(Path.view().size() && Path.view().front() == '/', "Route paths must start with '/'");
+		static_assert(Method != Request::Method::Other, "Routes can only be declared for standard methods");
+
+		static constexpr std::string_view path = Path.view();
+		static constexpr Request::Method method = Method;
+
+		static bool matches(std::string_view requestPath) noexcept
+		{
+			//size is known at compile time, so the memcmp is expanded inline and most routes are rejected by the size check alone
+			return requestPath.size() == path.size() && !std::memcmp(requestPath.data(), path.data(), path.size());
+		}
+
+		static void handle(Request &request, Response &response)
+		{
+			Handler(request, response);
+		}
+	};
+
+	//Routes known at build time, matched exactly and dispatched without std::function or a tree walk:
+	//	using Api = Http::RouteTable<Http::StaticRoute<"/health", health>, Http::StaticRoute<"/items", addItem, Http::Request::Method::Post>>;
+	//	server.setRouteTable<Api>();
+	//Same rules as Server::setResourceCallback with a method: 405 with Allow for other methods, HEAD served by GET.
+	template<typename... Routes>
+	class RouteTable
+	{
+		static_assert(sizeof...(Routes) > 0, "Route tables can't be empty");
+
+	public:
+		//false if no route has the request path, the request is left for the runtime routes then
+		static bool dispatch(Request &request, Response &response)
+		{
+			std::string_view path = request.getResourcePath();
+			std::uint32_t methods = ((Routes::matches(path) ? getMethodBit(Routes::method) : 0u) | ...);
+			Request::Method method = request.getMethodId();
+
+			if (!methods)
+				return false;
+
+			if (methods & getMethodBit(Request::Method::Get))
+				methods |= getMethodBit(Request::Method::Head);
+
+			if (method == Request::Method::Other || !(methods & getMethodBit(method)))
+			{
+				sendMethodNotAllowed(request, response, methods);
+				return true;
+			}
+
+			//HEAD without a route of its own is served by GET
+			if (method == Request::Method::Head && !((Routes::method == Request::Method::Head && Routes::matches(path)) || ...))
+				method = Request::Method::Get;
+
+			((Routes::method == method && Routes::matches(path) && (Routes::handle(request, response), true)) || ...);
+
+			return true;
+		}
+	};
+}
+
+#endif
@@ -5,12 +5,35 @@
 #include <stdexcept>
 #include <functional>
 #include <string_view>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <optional>
+#include <type_traits>
+#include "HttpRequest.h"
 
 namespace Http
 {
-	class Request;
 	class Response;
 
+	//non owning reference to the rest of a middleware chain, calling it passes the request on. See HttpMiddleware.h.
+	class Next
+	{
+		void (*mInvoke)(const void*, Request&, Response&);
+		const void *mTarget;
+	public:
+		template<typename Callable> requires (!std::is_same_v<Callable, Next>)
+		Next(const Callable &callable) noexcept
+			:mInvoke([](const void *target, Request &request, Response &response) { (*static_cast<const Callable*>(target))(request, response); })
+			,mTarget(&callable)
+		{}
+
+		void operator()(Request &request, Response &response) const
+		{
+			mInvoke(mTarget, request, response);
+		}
+	};
+
 	class EXPORT Server
 	{
 		class Impl;
@@ -18,17 +41,144 @@ namespace Http
 	public:
 		using HandlerCallback = void(Request&, Response&);
 		using LoggerCallback = void(std::string_view);
+		using MiddlewareCallback = void(Request&, Response&, Next);
+		//returns false if it has no route for the request, see RouteTable in HttpRouteTable.h
+		using RouteTableCallback = bool(Request&, Response&);
+		//Interactive disables Nagle's algorithm on accepted sockets, Bulk leaves it on. Responses sent with sendHeaders are corked until they end either way.
+		enum class WritePolicy { Interactive, Bulk };
+		//Prefix routes also match paths that extend their last segment ("/image" serves "/images" unless that's registered too), Exact ones don't
+		enum class RouteType { Prefix, Exact };
+
+		struct ResponseCachePolicy
+		{
+			std::chrono::milliseconds mTimeToLive = std::chrono::seconds(1);
+			std::chrono::milliseconds mStaleWhileRevalidate = std::chrono::milliseconds(0); //stale entries are served while one request refreshes them
+			std::vector<std::string> mQueryKeys; //query string keys that select different responses
+			std::vector<std::string> mVaryFields; //request fields that select different responses
+			std::size_t mMaxEntries = 1024;
+		};
+
+		struct WorkerConfiguration
+		{
+			std::size_t mWorkerCount = 0; //0 starts two workers per hardware thread
+			std::vector<unsigned> mCpus; //workers are pinned to these round robin, they aren't pinned if it's empty and there's no mNumaNode
+			std::optional<unsigned> mNumaNode; //pins workers to the CPUs of this node, if mCpus is empty
+			bool mFollowIncomingCpu = true; //connections go to a worker pinned to the CPU that received their packets, if there's one
+		};
+
+		struct AdmissionConfiguration
+		{
+			std::size_t mMaxPendingConnections = 4096; //queued or being served by any executor, further connections get a 503 from the accepting thread. 0 disables the limit.
+			std::chrono::milliseconds mTargetQueueDelay = std::chrono::milliseconds(100); //CoDel target, 0 disables queue delay based shedding
+			std::chrono::milliseconds mInterval = std::chrono::milliseconds(1000); //CoDel interval
+			std::chrono::seconds mRetryAfter = std::chrono::seconds(1);
+		};
+
+		struct ExecutorConfiguration
+		{
+			std::size_t mWorkerCount = 1; //requests its routes serve at once, further connections wait in its queue
+			std::vector<unsigned> mCpus; //workers are pinned to these round robin, they aren't pinned if it's empty
+		};
+
+		struct MemoryConfiguration
+		{
+			std::size_t mBudget = 0; //bytes open connections may hold, idle ones are closed oldest first past it and new ones get a 503. 0 disables it.
+			bool mHugePages = false; //request buffers come from huge pages when the system has them
+		};
+
+		struct TLSConfiguration
+		{
+			std::size_t mSessionCacheSize = 20480; //sessions kept for clients that resume by session id, 0 disables the cache
+			std::chrono::seconds mSessionLifetime = std::chrono::hours(2); //how long a client can resume its session, by id or with a ticket
+			std::chrono::seconds mTicketKeyRotation = std::chrono::hours(1); //session tickets are encrypted with a new key this often. Linux only, Schannel rotates its own.
+			bool mSessionTickets = true; //false keeps every session in the cache, clients can't hold them
+		};
+
+		struct ConnectionMemoryUsage
+		{
+			std::intptr_t mSocket;
+			std::size_t mBytes; //the connection, its request buffers and its TLS buffers
+			std::size_t mPeakBytes; //most held at once since it was accepted
+			bool mIdle; //waiting for its next request, it holds no request buffers then
+		};
+
+		struct MemoryUsage
+		{
+			std::size_t mBytes = 0; //held by open connections, what's checked against the budget
+			std::size_t mBufferBytes = 0; //request buffers, part of mBytes
+			std::size_t mSocketBufferBytes = 0; //the record buffers of TLS connections, part of mBytes
+			std::size_t mReservedBytes = 0; //taken from the system for request buffers, in use or not
+			std::size_t mIdleConnections = 0;
+			std::vector<ConnectionMemoryUsage> mConnections; //open ones
+		};
+
+		//listening sockets created by another process, -1 for the ones this server should create itself
+		struct Listeners
+		{
+			std::intptr_t mSocket = -1, mSocketSecure = -1;
+		};
+
+		//runs handlers on the thread that read the request, whichever executor that is. For handlers that never block.
+		static constexpr std::string_view inlineExecutor = "inline";
 
+		//certificateStore and certificateName are a system certificate store and the subject of the certificate in it on Windows,
+		//on Linux they're the paths of PEM files with the certificate chain and its private key
 		Server(std::uint16_t port = 80, std::uint16_t portSecure = 443, int connectionQueueLength = 6, std::string_view certificateStore = "", std::string_view certificateName = "");
+		//serves on listeners that are already bound, see getActivationListeners and receiveListeners
+		Server(const Listeners &listeners, int connectionQueueLength = 6, std::string_view certificateStore = "", std::string_view certificateName = "");
 		~Server() noexcept;
 		Server(Server&&) noexcept;
 		Server& operator=(Server&&) noexcept;
 
 		void start();
+		//stops accepting connections and sends Connection: close in the next response of every open one. Connections still waiting for
+		//a request when idleDeadline expires are closed. Returns once every connection is closed, the server can't be started again.
+		//Destroying a running server drains it with no deadline for idle connections.
+		void drain(std::chrono::milliseconds idleDeadline);
+		//sends the listening sockets to the process waiting on receiveListeners with the same path. Both processes accept connections from
+		//then on, drain this one once the other is serving. Linux only, throws std::runtime_error elsewhere or if nothing is waiting at path.
+		void handOffListeners(const std::string_view &path);
+		//systemd style socket activation: the first two descriptors passed in LISTEN_FDS, if they were meant for this process,
+		//serve plain HTTP and TLS in that order. Both are -1 if there are none.
+		static Listeners getActivationListeners();
+		//blocks until a running server calls handOffListeners with the same path, which names a Unix domain socket. Linux only.
+		static Listeners receiveListeners(const std::string_view &path);
 		//pass nullptr to remove current logger
 		void setEndpointLogger(const std::function<LoggerCallback> &callback) noexcept;
 		void setErrorLogger(const std::function<LoggerCallback> &callback) noexcept;
-		void setResourceCallback(const std::string_view &path, const std::function<HandlerCallback> &callback);
+		//path can contain {name} segments, available through Request::getPathParameter, and end with * to match everything below it
+		void setResourceCallback(const std::string_view &path, const std::function<HandlerCallback> &callback, RouteType type = RouteType::Prefix);
+		//callback only serves requests with that method, others get a 405 with an Allow field listing the registered ones.
+		//HEAD requests are served by the GET callback unless there's one for HEAD, response bodies are never sent for them.
+		void setResourceCallback(const std::string_view &path, Request::Method method, const std::function<HandlerCallback> &callback, RouteType type = RouteType::Prefix);
+		//caches the 200 responses to GET requests of the route registered with the same path and type, HEAD requests are served from them too.
+		//Handlers run once per key and expiration, responses with Set-Cookie are never stored.
+		void setResponseCache(const std::string_view &path, const ResponseCachePolicy &policy, RouteType type = RouteType::Prefix);
+		//routes declared at compile time, looked up before the ones registered with setResourceCallback. Pass nullptr to remove it.
+		void setRouteTable(RouteTableCallback *table) noexcept;
+		template<typename Table>
+		void setRouteTable() noexcept
+		{
+			setRouteTable(&Table::dispatch);
+		}
+		//runs for every request before it's routed, pass nullptr to remove it. Compose several with MiddlewareChain from HttpMiddleware.h.
+		void setMiddleware(const std::function<MiddlewareCallback> &middleware);
+		void setWritePolicy(WritePolicy policy) noexcept;
+		//takes effect on the next call to start
+		void setWorkerConfiguration(const WorkerConfiguration &configuration);
+		//takes effect on the next call to start
+		void setAdmissionConfiguration(const AdmissionConfiguration &configuration);
+		//takes effect on the next call to start
+		void setMemoryConfiguration(const MemoryConfiguration &configuration);
+		//takes effect on the next call to start
+		void setTLSConfiguration(const TLSConfiguration &configuration);
+		MemoryUsage getMemoryUsage() const;
+		//adds a named pool for setRouteExecutor, or reconfigures it. Takes effect on the next call to start.
+		void setExecutor(const std::string_view &name, const ExecutorConfiguration &configuration);
+		//requests to the route registered with the same path and type run on that executor, which must have been added with setExecutor or be
+		//inlineExecutor, otherwise std::invalid_argument is thrown. Connections move to the executor of each request they carry, so a slow route
+		//only ever holds the workers of its own executor. Routes without one run on the pool configured with setWorkerConfiguration.
+		void setRouteExecutor(const std::string_view &path, const std::string_view &executor, RouteType type = RouteType::Prefix);
 	};
 }
 
@@ -0,0 +1,34 @@
+#ifndef __HTTPSTATICFILEHANDLER__
+#define __HTTPSTATICFILEHANDLER__
+#include "ExportMacros.h"
+#include <string_view>
+#include <memory>
+#include <cstddef>
+#include <chrono>
+
+namespace Http
+{
+	class Request;
+	class Response;
+
+	//Endpoint that serves files from a directory, meant to be registered with Server::setResourceCallback.
+	//Answers If-None-Match and If-Modified-Since with 304 and sends file bodies without copying them to user space.
+	class EXPORT StaticFileHandler
+	{
+		class Impl;
+		std::shared_ptr<const Impl> mThis; //shared so the handler can be copied into a std::function
+	public:
+		//StaticFileHandler("./public", "/static/") serves ./public/app.css at /static/app.css
+		StaticFileHandler(std::string_view root, std::string_view prefix, std::string_view cacheControl = "no-cache");
+
+		void operator()(Request &request, Response &response) const;
+		//serves a single file, for handlers that map requests to files themselves
+		static void serve(Request &request, Response &response, std::string_view path, std::string_view cacheControl = "no-cache");
+		//files up to maxFileSize are kept in a process wide in-memory cache, along with their .gz siblings. Defaults to 64 MiB and 512 KiB.
+		static void setCacheLimits(std::size_t memoryBudget, std::size_t maxFileSize) noexcept;
+		//larger files are kept open for timeToLive before their metadata is checked again. Defaults to 2 seconds and 1024 files.
+		static void setDescriptorCacheLimits(std::chrono::milliseconds timeToLive, std::size_t maxOpenFiles) noexcept;
+	};
+}
+
+#endif
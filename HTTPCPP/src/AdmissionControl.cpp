@@ -0,0 +1,55 @@
+#include "AdmissionControl.h"
+#include <limits>
+
+namespace
+{
+	std::int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+}
+
+AdmissionControl::AdmissionControl(std::chrono::nanoseconds target, std::chrono::nanoseconds interval) noexcept
+	:mTarget(target.count()),
+	mInterval(interval.count()),
+	mIntervalStart(now()),
+	mMinimumDelay(std::numeric_limits<std::int64_t>::max())
+{}
+
+void AdmissionControl::update(std::int64_t now) noexcept
+{
+	std::int64_t intervalStart = mIntervalStart.load(std::memory_order_relaxed);
+
+	if (now - intervalStart < mInterval.load(std::memory_order_relaxed))
+		return;
+
+	//only one thread closes each interval
+	if (mIntervalStart.compare_exchange_strong(intervalStart, now, std::memory_order_relaxed))
+	{
+		std::int64_t minimum = mMinimumDelay.exchange(std::numeric_limits<std::int64_t>::max(), std::memory_order_relaxed);
+
+		//an interval without dequeues means the queue was empty, or the workers are stuck and the pending limit takes over
+		mOverloaded.store(minimum != std::numeric_limits<std::int64_t>::max() && minimum > mTarget.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+}
+
+void AdmissionControl::setParameters(std::chrono::nanoseconds target, std::chrono::nanoseconds interval) noexcept
+{
+	mTarget.store(target.count(), std::memory_order_relaxed);
+	mInterval.store(interval.count(), std::memory_order_relaxed);
+}
+
+bool AdmissionControl::shouldShed(Clock::duration queueDelay) noexcept
+{
+	std::int64_t delay = std::chrono::duration_cast<std::chrono::nanoseconds>(queueDelay).count();
+	std::int64_t minimum = mMinimumDelay.load(std::memory_order_relaxed);
+
+	if (!mTarget.load(std::memory_order_relaxed))
+		return false;
+
+	while (delay < minimum && !mMinimumDelay.compare_exchange_weak(minimum, delay, std::memory_order_relaxed));
+
+	update(now());
+
+	return mOverloaded.load(std::memory_order_relaxed) && delay > 2 * mTarget.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,29 @@
+#ifndef __ADMISSIONCONTROL__
+#define __ADMISSIONCONTROL__
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+//CoDel applied to accepted connections, as done by some RPC servers: the queue is considered overloaded when even
+//the fastest connection of the last interval waited longer than the target to reach a worker. While it is,
+//connections that waited longer than twice the target are turned away, so the queue drains instead of every
+//client seeing the whole backlog as latency.
+class AdmissionControl
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::atomic<std::int64_t> mTarget, mInterval; //nanoseconds
+	std::atomic<std::int64_t> mIntervalStart;
+	std::atomic<std::int64_t> mMinimumDelay; //of the current interval, INT64_MAX if nothing was dequeued in it
+	std::atomic<bool> mOverloaded = false;
+
+	void update(std::int64_t now) noexcept;
+public:
+	AdmissionControl(std::chrono::nanoseconds target, std::chrono::nanoseconds interval) noexcept;
+
+	void setParameters(std::chrono::nanoseconds target, std::chrono::nanoseconds interval) noexcept;
+	//called when a connection reaches a worker, true if it should be answered with 503 instead
+	bool shouldShed(Clock::duration queueDelay) noexcept;
+};
+
+#endif
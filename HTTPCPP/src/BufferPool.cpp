@@ -0,0 +1,167 @@
+#include "BufferPool.h"
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace
+{
+	constexpr std::size_t pageSize = 4096; //buffers are aligned to their own size within the slab, which is at least this
+}
+
+void* BufferPool::allocateSlab()
+{
+	void *slab = nullptr;
+
+	#ifdef _WIN32
+	if (SIZE_T largePage = GetLargePageMinimum(); mHugePages.load(std::memory_order_relaxed) && largePage && !(slabSize % largePage))
+		slab = VirtualAlloc(nullptr, slabSize, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE); //needs SeLockMemoryPrivilege
+	if (!slab)
+		slab = VirtualAlloc(nullptr, slabSize, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (!slab)
+		throw std::bad_alloc();
+	#elif defined(__linux__)
+	slab = MAP_FAILED;
+	if (mHugePages.load(std::memory_order_relaxed))
+		slab = mmap(nullptr, slabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (slab == MAP_FAILED)
+	{
+		slab = mmap(nullptr, slabSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (slab == MAP_FAILED)
+			throw std::bad_alloc();
+		if (mHugePages.load(std::memory_order_relaxed))
+			madvise(slab, slabSize, MADV_HUGEPAGE); //transparent huge pages, when none are reserved
+	}
+	#endif
+
+	std::lock_guard<std::mutex> lck(mSlabMutex);
+
+	mSlabs.push_back(slab);
+	mReserved.fetch_add(slabSize, std::memory_order_relaxed);
+
+	return slab;
+}
+
+void* BufferPool::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+	std::size_t index = 0;
+
+	while (index < bufferSizes.size() && bytes > bufferSizes[index])
+		++index;
+
+	if (index == bufferSizes.size() || alignment > pageSize)
+	{
+		void *buffer = ::operator new(bytes, std::align_val_t(alignment));
+
+		mUsed.fetch_add(bytes, std::memory_order_relaxed);
+		mReserved.fetch_add(bytes, std::memory_order_relaxed);
+		return buffer;
+	}
+
+	SizeClass &sizeClass = mClasses[index];
+	std::size_t size = bufferSizes[index];
+
+	mUsed.fetch_add(size, std::memory_order_relaxed);
+
+	{
+		std::lock_guard<std::mutex> lck(sizeClass.mMutex);
+
+		if (FreeBuffer *buffer = sizeClass.mFree)
+		{
+			sizeClass.mFree = buffer->mNext;
+			return buffer;
+		}
+	}
+
+	std::byte *slab;
+
+	try
+	{
+		slab = static_cast<std::byte*>(allocateSlab());
+	}
+	catch (const std::bad_alloc&)
+	{
+		mUsed.fetch_sub(size, std::memory_order_relaxed);
+		throw;
+	}
+
+	//the first buffer is the one returned, the rest are linked before taking the lock
+	FreeBuffer *head = nullptr, *tail = nullptr;
+
+	for (std::size_t offset = size; offset < slabSize; offset += size)
+	{
+		FreeBuffer *buffer = ::new (slab + offset) FreeBuffer{ head };
+
+		if (!tail)
+			tail = buffer;
+		head = buffer;
+	}
+
+	if (head)
+	{
+		std::lock_guard<std::mutex> lck(sizeClass.mMutex);
+
+		tail->mNext = sizeClass.mFree;
+		sizeClass.mFree = head;
+	}
+
+	return slab;
+}
+
+void BufferPool::do_deallocate(void *buffer, std::size_t bytes, std::size_t alignment)
+{
+	std::size_t index = 0;
+
+	while (index < bufferSizes.size() && bytes > bufferSizes[index])
+		++index;
+
+	if (index == bufferSizes.size() || alignment > pageSize)
+	{
+		::operator delete(buffer, bytes, std::align_val_t(alignment));
+		mUsed.fetch_sub(bytes, std::memory_order_relaxed);
+		mReserved.fetch_sub(bytes, std::memory_order_relaxed);
+		return;
+	}
+
+	SizeClass &sizeClass = mClasses[index];
+
+	{
+		std::lock_guard<std::mutex> lck(sizeClass.mMutex);
+
+		sizeClass.mFree = ::new (buffer) FreeBuffer{ sizeClass.mFree };
+	}
+	mUsed.fetch_sub(bufferSizes[index], std::memory_order_relaxed);
+}
+
+bool BufferPool::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+	return this == &other;
+}
+
+BufferPool::~BufferPool()
+{
+	for (void *slab : mSlabs)
+		#ifdef _WIN32
+		VirtualFree(slab, 0, MEM_RELEASE);
+		#elif defined(__linux__)
+		munmap(slab, slabSize);
+		#endif
+}
+
+void BufferPool::setHugePages(bool toggle) noexcept
+{
+	mHugePages.store(toggle, std::memory_order_relaxed);
+}
+
+std::size_t BufferPool::getUsedBytes() const noexcept
+{
+	return mUsed.load(std::memory_order_relaxed);
+}
+
+std::size_t BufferPool::getReservedBytes() const noexcept
+{
+	return mReserved.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,55 @@
+#ifndef __BUFFERPOOL__
+#define __BUFFERPOOL__
+#include <memory_resource>
+#include <array>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <cstddef>
+
+//Request buffers in a few fixed sizes, carved from 2 MiB slabs that are kept for the life of the pool. Connections take buffers
+//when a request arrives and give them back once it's served, so idle ones hold none and the memory of a burst is reused
+//instead of fragmenting the heap. Slabs can be backed by huge pages, which saves TLB misses when thousands of connections
+//are busy at once. Buffers above the largest size come from the heap. Thread safe.
+class BufferPool : public std::pmr::memory_resource
+{
+	static constexpr std::size_t slabSize = 2 * 1024 * 1024; //a huge page on x86-64 and most ARM configurations
+	static constexpr std::array<std::size_t, 4> bufferSizes = { 4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024 };
+
+	struct FreeBuffer
+	{
+		FreeBuffer *mNext;
+	};
+
+	struct alignas(64) SizeClass
+	{
+		std::mutex mMutex;
+		FreeBuffer *mFree = nullptr;
+	};
+
+	std::array<SizeClass, bufferSizes.size()> mClasses;
+	std::mutex mSlabMutex;
+	std::vector<void*> mSlabs;
+	std::atomic<bool> mHugePages = false;
+	std::atomic<std::size_t> mUsed = 0, mReserved = 0;
+
+	void* allocateSlab();
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+	void do_deallocate(void *buffer, std::size_t bytes, std::size_t alignment) override;
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+public:
+	BufferPool() = default;
+	BufferPool(const BufferPool&) = delete;
+	BufferPool& operator=(const BufferPool&) = delete;
+	//every buffer must have been given back
+	~BufferPool() override;
+
+	//for the slabs allocated from then on. Falls back to regular pages when the system has no huge pages to give.
+	void setHugePages(bool toggle) noexcept;
+	//handed out and not given back yet
+	std::size_t getUsedBytes() const noexcept;
+	//taken from the system, in use or not
+	std::size_t getReservedBytes() const noexcept;
+};
+
+#endif
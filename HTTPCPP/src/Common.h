@@ -2,8 +2,9 @@
 #define __NAMES__
 #include <algorithm>
 #include <string>
+#include <string_view>
 
-inline bool CaseInsensitiveComparator(const std::string &lhs, const std::string &rhs)
+inline bool CaseInsensitiveComparator(std::string_view lhs, std::string_view rhs)
 {
 	return std::lexicographical_compare(lhs.cbegin(),
 										lhs.cend(),
@@ -12,4 +13,15 @@ inline bool CaseInsensitiveComparator(const std::string &lhs, const std::string
 										[](char lhs, char rhs) -> bool { return std::toupper(lhs) < std::toupper(rhs); });
 }
 
-#endif
\ No newline at end of file
+//CaseInsensitiveComparator for ordered containers, lookups take any string type without building a key
+struct CaseInsensitiveLess
+{
+	using is_transparent = void;
+
+	bool operator()(std::string_view lhs, std::string_view rhs) const
+	{
+		return CaseInsensitiveComparator(lhs, rhs);
+	}
+};
+
+#endif
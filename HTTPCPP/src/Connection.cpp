@@ -0,0 +1,179 @@
+#include "Connection.h"
+#include <utility>
+
+Connection::Connection(ConnectionPool *pool, std::pmr::memory_resource *buffers)
+	:mPool(pool)
+	,mArena(buffers)
+{}
+
+void Connection::open(DescriptorType socket)
+{
+	mSocket.emplace(socket);
+	mOpened = std::chrono::steady_clock::now();
+	mArena.resetPeakBytes();
+	mPeakSocketBytes.store(0, std::memory_order_relaxed);
+	mDescriptor.store(static_cast<std::intptr_t>(socket), std::memory_order_relaxed);
+}
+
+void Connection::open(DescriptorType socket, const std::shared_ptr<const TLSContext> &context)
+{
+	mSecureSocket.emplace(Socket(socket), context);
+	mOpened = std::chrono::steady_clock::now();
+	mArena.resetPeakBytes();
+	mPeakSocketBytes.store(0, std::memory_order_relaxed);
+	mDescriptor.store(static_cast<std::intptr_t>(socket), std::memory_order_relaxed);
+}
+
+void Connection::close() noexcept
+{
+	mDescriptor.store(-1, std::memory_order_relaxed);
+	mIdle.store(false, std::memory_order_relaxed);
+	mSocket.reset();
+	mSecureSocket.reset();
+	updateSocketBytes();
+	mArena.reset(); //a connection waiting in the pool holds no buffers
+}
+
+Socket& Connection::getSocket() noexcept
+{
+	return mSecureSocket ? *mSecureSocket : *mSocket;
+}
+
+TLSSocket* Connection::getSecureSocket() noexcept
+{
+	return mSecureSocket ? &*mSecureSocket : nullptr;
+}
+
+std::chrono::steady_clock::time_point Connection::getOpenedTime() const noexcept
+{
+	return mOpened;
+}
+
+RequestArena& Connection::getArena() noexcept
+{
+	return mArena;
+}
+
+void Connection::setIdle(bool idle) noexcept
+{
+	mIdle.store(idle, std::memory_order_relaxed);
+}
+
+bool Connection::isIdle() const noexcept
+{
+	return mIdle.load(std::memory_order_relaxed);
+}
+
+std::intptr_t Connection::getDescriptor() const noexcept
+{
+	return mDescriptor.load(std::memory_order_relaxed);
+}
+
+void Connection::updateSocketBytes() noexcept
+{
+	std::size_t bytes = mSecureSocket ? mSecureSocket->getBufferBytes() : 0;
+	std::size_t previous = mSocketBytes.exchange(bytes, std::memory_order_relaxed);
+
+	if (bytes == previous)
+		return;
+	mPool->mSocketBytes.fetch_add(bytes - previous, std::memory_order_relaxed); //wraps around to a subtraction when they were freed
+	if (bytes > mPeakSocketBytes.load(std::memory_order_relaxed))
+		mPeakSocketBytes.store(bytes, std::memory_order_relaxed); //only the serving thread writes it
+}
+
+std::size_t Connection::getMemoryUsage() const noexcept
+{
+	return sizeof(Connection) + mArena.getBytes() + mSocketBytes.load(std::memory_order_relaxed);
+}
+
+std::size_t Connection::getPeakMemoryUsage() const noexcept
+{
+	return sizeof(Connection) + mArena.getPeakBytes() + mPeakSocketBytes.load(std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+void ConnectionPool::destroy(Connection *list) noexcept
+{
+	std::lock_guard<std::mutex> lck(mAllMutex);
+
+	while (list)
+	{
+		Connection *connection = std::exchange(list, list->mNext);
+
+		mAll[connection->mIndex] = mAll.back();
+		mAll[connection->mIndex]->mIndex = connection->mIndex;
+		mAll.pop_back();
+		delete connection;
+	}
+}
+
+ConnectionPool::ConnectionPool(std::pmr::memory_resource *buffers) noexcept
+	:mBuffers(buffers)
+{}
+
+ConnectionPool::~ConnectionPool()
+{
+	destroy(mFree);
+	destroy(mReturned.load(std::memory_order_acquire));
+}
+
+ConnectionPool::Pointer ConnectionPool::acquire()
+{
+	if (!mFree)
+	{
+		mFree = mReturned.exchange(nullptr, std::memory_order_acquire);
+		mFreeCount = 0;
+
+		//connections accepted in a burst come back all at once, only keep as many as the pool holds
+		for (Connection *connection = mFree; connection; connection = connection->mNext)
+			if (++mFreeCount == maxFree)
+			{
+				destroy(std::exchange(connection->mNext, nullptr));
+				break;
+			}
+	}
+
+	if (!mFree)
+	{
+		std::unique_ptr<Connection> connection(new Connection(this, mBuffers));
+		std::lock_guard<std::mutex> lck(mAllMutex);
+
+		connection->mIndex = mAll.size();
+		mAll.push_back(connection.get());
+		return Pointer(connection.release());
+	}
+
+	--mFreeCount;
+	return Pointer(std::exchange(mFree, mFree->mNext));
+}
+
+void ConnectionPool::release(Connection *connection) noexcept
+{
+	Connection *head = mReturned.load(std::memory_order_relaxed);
+
+	connection->close();
+	do
+		connection->mNext = head;
+	while (!mReturned.compare_exchange_weak(head, connection, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void ConnectionPool::forEach(const std::function<void(const Connection&)> &callback) const
+{
+	std::lock_guard<std::mutex> lck(mAllMutex);
+
+	for (const Connection *connection : mAll)
+		callback(*connection);
+}
+
+std::size_t ConnectionPool::getSocketBytes() const noexcept
+{
+	return mSocketBytes.load(std::memory_order_relaxed);
+}
+
+void ConnectionPool::Recycler::operator()(Connection *connection) const noexcept
+{
+	connection->mPool->release(connection);
+}
@@ -0,0 +1,106 @@
+#ifndef __CONNECTION__
+#define __CONNECTION__
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <chrono>
+#include <string_view>
+#include "Socket.h"
+#include "TLSContext.h"
+#include "RequestArena.h"
+
+class ConnectionPool;
+
+//An accepted client: its socket and the arena its requests allocate from. A connection belongs to one thread at a time and
+//requests and responses only borrow its socket, so ownership needs no reference counting. The memory figures can be read
+//from any thread.
+class Connection
+{
+	friend class ConnectionPool;
+
+	ConnectionPool *mPool;
+	Connection *mNext = nullptr; //in the pool's lists
+	std::size_t mIndex = 0; //in the pool's list of every connection
+	std::optional<Socket> mSocket;
+	std::optional<TLSSocket> mSecureSocket;
+	RequestArena mArena;
+	std::atomic<std::intptr_t> mDescriptor = -1; //while open
+	std::atomic<bool> mIdle = false;
+	std::atomic<std::size_t> mSocketBytes = 0, mPeakSocketBytes = 0; //of the TLS socket's buffers, as of the last updateSocketBytes
+	std::chrono::steady_clock::time_point mOpened;
+
+	Connection(ConnectionPool *pool, std::pmr::memory_resource *buffers);
+public:
+	Connection(const Connection&) = delete;
+	Connection& operator=(const Connection&) = delete;
+
+	//take ownership of a socket returned from Socket::acceptDescriptor
+	void open(DescriptorType socket);
+	//handshakes with context's credentials once the first request is read
+	void open(DescriptorType socket, const std::shared_ptr<const TLSContext> &context);
+	void close() noexcept;
+	Socket& getSocket() noexcept;
+	//nullptr for plain connections
+	TLSSocket* getSecureSocket() noexcept;
+	std::chrono::steady_clock::time_point getOpenedTime() const noexcept;
+	RequestArena& getArena() noexcept;
+	//waiting for its next request, with no buffers
+	void setIdle(bool idle) noexcept;
+	bool isIdle() const noexcept;
+	//-1 if the connection is closed
+	std::intptr_t getDescriptor() const noexcept;
+	//counts the buffers the TLS socket holds now in this connection's figures and the pool's, from the thread serving it
+	void updateSocketBytes() noexcept;
+	//the connection object, the buffers its arena holds and those of its TLS socket
+	std::size_t getMemoryUsage() const noexcept;
+	//most held at once since it was opened
+	std::size_t getPeakMemoryUsage() const noexcept;
+};
+
+//Closed connections kept for reuse, so accepting one doesn't allocate a socket and an arena. Only the accepting thread takes
+//connections, any thread gives them back. Returned ones go on a lock-free stack that the accepting thread empties in a single
+//exchange, so nothing is ever popped from it concurrently and the ABA problem of such stacks can't happen.
+class ConnectionPool
+{
+	friend class Connection; //updates mSocketBytes
+
+	static constexpr std::size_t maxFree = 1024; //closed connections kept, the rest are freed
+
+	std::pmr::memory_resource *mBuffers;
+	Connection *mFree = nullptr; //accepting thread only
+	std::size_t mFreeCount = 0;
+	std::atomic<Connection*> mReturned = nullptr;
+	std::atomic<std::size_t> mSocketBytes = 0; //every connection's
+	mutable std::mutex mAllMutex; //taken when connections are created or freed, not when they're reused
+	std::vector<Connection*> mAll;
+
+	void destroy(Connection *list) noexcept;
+public:
+	struct Recycler
+	{
+		void operator()(Connection *connection) const noexcept;
+	};
+	using Pointer = std::unique_ptr<Connection, Recycler>;
+
+	//connection arenas take their blocks from buffers, which must outlive the pool
+	ConnectionPool(std::pmr::memory_resource *buffers) noexcept;
+	ConnectionPool(const ConnectionPool&) = delete;
+	ConnectionPool& operator=(const ConnectionPool&) = delete;
+	//every connection must have been given back
+	~ConnectionPool();
+
+	//a closed connection, only called from the accepting thread
+	Pointer acquire();
+	//closes the connection, from any thread
+	void release(Connection *connection) noexcept;
+	//calls callback for every connection, open or not, while none can be freed. From any thread.
+	void forEach(const std::function<void(const Connection&)> &callback) const;
+	//held by the TLS sockets of every connection, see Connection::updateSocketBytes
+	std::size_t getSocketBytes() const noexcept;
+};
+
+#endif
@@ -0,0 +1,158 @@
+#include "File.h"
+#include <string>
+#include <utility>
+#include <algorithm>
+
+#ifdef __linux__
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#define INVALID_HANDLE_VALUE (-1)
+#endif
+
+namespace
+{
+	[[noreturn]] void throwLastError(std::string_view path)
+	{
+		#ifdef _WIN32
+		throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), std::string(path));
+		#elif defined(__linux__)
+		throw std::system_error(errno, std::system_category(), std::string(path));
+		#endif
+	}
+}
+
+File::File(std::string_view path)
+	:mHandle(INVALID_HANDLE_VALUE),
+	mStatus()
+{
+	std::string nullTerminatedPath(path);
+
+	#ifdef _WIN32
+	BY_HANDLE_FILE_INFORMATION information;
+
+	mHandle = CreateFileA(nullTerminatedPath.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (mHandle == INVALID_HANDLE_VALUE)
+		throwLastError(path);
+
+	if (!GetFileInformationByHandle(mHandle, &information))
+	{
+		DWORD error = GetLastError();
+
+		close();
+		throw std::system_error(static_cast<int>(error), std::system_category(), nullTerminatedPath);
+	}
+
+	//FILETIME counts 100 nanosecond intervals since 1601-01-01
+	constexpr std::int64_t intervalsPerSecond = 10000000, epochDifference = 11644473600;
+	std::int64_t lastWrite = (static_cast<std::int64_t>(information.ftLastWriteTime.dwHighDateTime) << 32) | information.ftLastWriteTime.dwLowDateTime;
+
+	mStatus.size = (static_cast<std::uint64_t>(information.nFileSizeHigh) << 32) | information.nFileSizeLow;
+	mStatus.lastWriteTime = lastWrite / intervalsPerSecond - epochDifference;
+	mStatus.identity = (static_cast<std::uint64_t>(information.nFileIndexHigh) << 32) | information.nFileIndexLow;
+	#elif defined(__linux__)
+	struct stat status;
+
+	mHandle = ::open(nullTerminatedPath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (mHandle == INVALID_HANDLE_VALUE)
+		throwLastError(path);
+
+	if (int error = fstat(mHandle, &status) == -1 ? errno : (S_ISREG(status.st_mode) ? 0 : EISDIR))
+	{
+		close();
+		throw std::system_error(error, std::system_category(), nullTerminatedPath);
+	}
+
+	mStatus.size = static_cast<std::uint64_t>(status.st_size);
+	mStatus.lastWriteTime = status.st_mtime;
+	mStatus.identity = status.st_ino;
+	#endif
+}
+
+File::File(File &&other) noexcept
+	:mHandle(std::exchange(other.mHandle, INVALID_HANDLE_VALUE)),
+	mStatus(other.mStatus)
+{}
+
+File::~File()
+{
+	close();
+}
+
+File& File::operator=(File &&other) noexcept
+{
+	close();
+	mHandle = std::exchange(other.mHandle, INVALID_HANDLE_VALUE);
+	mStatus = other.mStatus;
+
+	return *this;
+}
+
+void File::close() noexcept
+{
+	if (mHandle != INVALID_HANDLE_VALUE)
+	{
+		#ifdef _WIN32
+		CloseHandle(mHandle);
+		#elif defined(__linux__)
+		::close(mHandle);
+		#endif
+		mHandle = INVALID_HANDLE_VALUE;
+	}
+}
+
+std::size_t File::read(void *buffer, std::size_t bufferSize, std::uint64_t offset) const
+{
+	#ifdef _WIN32
+	OVERLAPPED position = {};
+	DWORD bytesRead = 0;
+
+	position.Offset = static_cast<DWORD>(offset);
+	position.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+	if (!ReadFile(mHandle, buffer, static_cast<DWORD>(std::min<std::size_t>(bufferSize, MAXDWORD)), &bytesRead, &position) && GetLastError() != ERROR_HANDLE_EOF)
+		throw std::system_error(static_cast<int>(GetLastError()), std::system_category());
+
+	return bytesRead;
+	#elif defined(__linux__)
+	ssize_t bytesRead;
+
+	do
+		bytesRead = pread(mHandle, buffer, bufferSize, static_cast<off_t>(offset));
+	while (bytesRead == -1 && errno == EINTR);
+
+	if (bytesRead == -1)
+		throw std::system_error(errno, std::system_category());
+
+	return static_cast<std::size_t>(bytesRead);
+	#endif
+}
+
+File::Status File::stat(std::string_view path)
+{
+	#ifdef _WIN32
+	return File(path).getStatus(); //the file index is only available through a handle
+	#elif defined(__linux__)
+	std::string nullTerminatedPath(path);
+	struct stat status;
+
+	if (::stat(nullTerminatedPath.c_str(), &status) == -1)
+		throw std::system_error(errno, std::system_category(), nullTerminatedPath);
+	if (!S_ISREG(status.st_mode))
+		throw std::system_error(EISDIR, std::system_category(), nullTerminatedPath);
+
+	return Status { static_cast<std::uint64_t>(status.st_size), status.st_mtime, status.st_ino };
+	#endif
+}
+
+const File::Status& File::getStatus() const noexcept
+{
+	return mStatus;
+}
+
+FileDescriptorType File::get() const noexcept
+{
+	return mHandle;
+}
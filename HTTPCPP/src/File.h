@@ -0,0 +1,49 @@
+#ifndef __FILEHANDLE__
+#define __FILEHANDLE__
+#include <cstdint>
+#include <cstddef>
+#include <string_view>
+#include <system_error>
+
+#ifdef _WIN32
+#include <windows.h>
+using FileDescriptorType = HANDLE;
+#elif defined __linux__
+using FileDescriptorType = int;
+#endif
+
+//read only file, opened for serving
+class File
+{
+public:
+	struct Status
+	{
+		std::uint64_t size;
+		std::int64_t lastWriteTime; //seconds since the unix epoch
+		std::uint64_t identity; //inode or file index, changes when the file is replaced
+
+		bool operator==(const Status&) const = default;
+	};
+private:
+	FileDescriptorType mHandle;
+	Status mStatus;
+
+	void close() noexcept;
+public:
+	//throws std::system_error if the file can't be opened
+	File(std::string_view path);
+	File(const File&) = delete;
+	File(File&&) noexcept;
+	~File();
+	File& operator=(const File&) = delete;
+	File& operator=(File&&) noexcept;
+
+	//status of the file at path without keeping it open, throws std::system_error like the constructor
+	static Status stat(std::string_view path);
+	//does not move the file pointer, so it's safe to call from several threads
+	std::size_t read(void *buffer, std::size_t bufferSize, std::uint64_t offset) const;
+	const Status& getStatus() const noexcept;
+	FileDescriptorType get() const noexcept;
+};
+
+#endif
@@ -0,0 +1,333 @@
+#include "FileCache.h"
+#include "FileMetadata.h"
+#include <chrono>
+#include <functional>
+#include <system_error>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	std::int64_t now()
+	{
+		return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	std::vector<std::uint8_t> readContents(const File &file)
+	{
+		std::vector<std::uint8_t> result(file.getStatus().size);
+		std::size_t bytesRead = 0;
+
+		while (bytesRead < result.size())
+		{
+			std::size_t aux = file.read(result.data() + bytesRead, result.size() - bytesRead, bytesRead);
+
+			if (!aux)
+				break; //file got shorter while reading it
+			bytesRead += aux;
+		}
+
+		result.resize(bytesRead);
+
+		return result;
+	}
+}
+
+std::size_t FileCache::Entry::getMemoryUsage() const noexcept
+{
+	return sizeof(Entry) + mContents.capacity() + (mCompressed ? mCompressed->capacity() : 0) + mETag.capacity() + mLastModified.capacity();
+}
+
+FileCache::FileCache(std::size_t memoryBudget, std::size_t maxFileSize)
+	:mShardBudget(memoryBudget / shardCount),
+	mMaxFileSize(maxFileSize)
+{
+	#ifdef __linux__
+	mNotifier = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (mNotifier != -1)
+		mWatcher = std::jthread([this](std::stop_token stopToken) { watcherProcedure(stopToken); });
+	#endif
+}
+
+FileCache::~FileCache()
+{
+	#ifdef __linux__
+	if (mWatcher.joinable())
+	{
+		mWatcher.request_stop();
+		mWatcher.join();
+	}
+	if (mNotifier != -1)
+		::close(mNotifier);
+	#endif
+}
+
+FileCache::Shard& FileCache::getShard(std::string_view path)
+{
+	return mShards[std::hash<std::string_view>()(path) % shardCount];
+}
+
+std::shared_ptr<const FileCache::Entry> FileCache::load(std::string_view path) const
+{
+	File file(path);
+	const File::Status &status = file.getStatus();
+
+	if (status.size > mMaxFileSize.load(std::memory_order_relaxed))
+		return nullptr;
+
+	auto entry = std::make_shared<Entry>();
+
+	entry->mContents = readContents(file);
+	entry->mStatus = status;
+	entry->mStatus.size = entry->mContents.size();
+	entry->mETag = makeETag(entry->mStatus);
+	entry->mLastModified = formatHttpDate(status.lastWriteTime);
+	entry->mMimeType = getMimeType(path);
+
+	try
+	{
+		File compressed(std::string(path) + ".gz");
+
+		//an older .gz file was probably left behind when the original was updated, don't serve it
+		if (compressed.getStatus().lastWriteTime >= status.lastWriteTime && compressed.getStatus().size < entry->mContents.size())
+			entry->mCompressed = readContents(compressed);
+	}
+	catch (const std::system_error&)
+	{}
+
+	return entry;
+}
+
+void FileCache::erase(Shard &shard, std::unordered_map<std::string, Slot>::iterator slot)
+{
+	shard.mMemoryUsage -= slot->second.mEntry->getMemoryUsage();
+	shard.mRecency.erase(slot->second.mRecency);
+	shard.mEntries.erase(slot);
+}
+
+void FileCache::evict(Shard &shard)
+{
+	while (shard.mMemoryUsage > mShardBudget.load(std::memory_order_relaxed) && !shard.mRecency.empty())
+		erase(shard, shard.mEntries.find(shard.mRecency.back()));
+}
+
+std::shared_ptr<const FileCache::Entry> FileCache::get(std::string_view path, const File::Status &status)
+{
+	if (status.size > mMaxFileSize.load(std::memory_order_relaxed))
+		return nullptr;
+
+	Shard &shard = getShard(path);
+	std::string key(path);
+	std::shared_ptr<const Entry> entry;
+	std::uint64_t generation;
+	bool revalidate = true, cacheable = true;
+
+	#ifdef __linux__
+	revalidate = mNotifier == -1;
+	#endif
+
+	{
+		std::lock_guard<std::mutex> lck(shard.mMutex);
+		auto slot = shard.mEntries.find(key);
+
+		generation = shard.mGeneration;
+		if (slot != shard.mEntries.end())
+		{
+			shard.mRecency.splice(shard.mRecency.begin(), shard.mRecency, slot->second.mRecency);
+			if (!revalidate || now() - slot->second.mValidatedAt < 1)
+				return slot->second.mEntry;
+			entry = slot->second.mEntry;
+		}
+	}
+
+	if (entry) //stale, a stat is enough to know if it can still be used
+	{
+		try
+		{
+			File::Status current = File::stat(path);
+			const File::Status &cached = entry->mStatus;
+
+			if (current.size == cached.size && current.lastWriteTime == cached.lastWriteTime && current.identity == cached.identity)
+			{
+				std::lock_guard<std::mutex> lck(shard.mMutex);
+				auto slot = shard.mEntries.find(key);
+
+				if (slot != shard.mEntries.end() && slot->second.mEntry == entry)
+					slot->second.mValidatedAt = now();
+
+				return entry;
+			}
+		}
+		catch (const std::system_error&)
+		{
+			invalidate(path);
+			return nullptr;
+		}
+	}
+
+	#ifdef __linux__
+	if (!revalidate)
+		cacheable = watch(path); //before reading the file, so a change in between isn't missed
+	#endif
+
+	try
+	{
+		entry = load(path);
+	}
+	catch (const std::system_error&)
+	{
+		invalidate(path);
+		return nullptr;
+	}
+
+	if (!entry || !cacheable || entry->getMemoryUsage() > mShardBudget.load(std::memory_order_relaxed))
+	{
+		invalidate(path);
+		return entry;
+	}
+
+	std::lock_guard<std::mutex> lck(shard.mMutex);
+
+	//the file may have changed while it was read and the watcher's invalidate already ran, what was read can't be trusted to be current
+	if (shard.mGeneration != generation)
+		return entry;
+
+	auto slot = shard.mEntries.find(key);
+
+	if (slot != shard.mEntries.end()) //stale, or another thread loaded it first
+		erase(shard, slot);
+
+	shard.mRecency.push_front(key);
+	shard.mEntries.emplace(std::move(key), Slot { entry, shard.mRecency.begin(), now() });
+	shard.mMemoryUsage += entry->getMemoryUsage();
+	evict(shard);
+
+	return entry;
+}
+
+void FileCache::invalidate(std::string_view path)
+{
+	Shard &shard = getShard(path);
+	std::lock_guard<std::mutex> lck(shard.mMutex);
+	auto slot = shard.mEntries.find(std::string(path));
+
+	++shard.mGeneration;
+	if (slot != shard.mEntries.end())
+		erase(shard, slot);
+}
+
+void FileCache::clear()
+{
+	for (Shard &shard : mShards)
+	{
+		std::lock_guard<std::mutex> lck(shard.mMutex);
+
+		shard.mEntries.clear();
+		shard.mRecency.clear();
+		shard.mMemoryUsage = 0;
+		++shard.mGeneration;
+	}
+}
+
+void FileCache::setLimits(std::size_t memoryBudget, std::size_t maxFileSize) noexcept
+{
+	mShardBudget.store(memoryBudget / shardCount, std::memory_order_relaxed);
+	mMaxFileSize.store(maxFileSize, std::memory_order_relaxed);
+
+	for (Shard &shard : mShards)
+	{
+		std::lock_guard<std::mutex> lck(shard.mMutex);
+		evict(shard);
+	}
+}
+
+FileCache& FileCache::getInstance()
+{
+	static FileCache instance(64 * 1024 * 1024, 512 * 1024);
+
+	return instance;
+}
+
+#ifdef __linux__
+bool FileCache::watch(std::string_view path)
+{
+	auto lastSlash = path.rfind('/');
+	std::string prefix(path.substr(0, lastSlash == std::string_view::npos ? 0 : lastSlash + 1));
+	std::lock_guard<std::mutex> lck(mWatchMutex);
+
+	if (mWatchDescriptors.contains(prefix))
+		return true;
+
+	int watchDescriptor = inotify_add_watch(mNotifier, prefix.empty() ? "." : prefix.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO);
+
+	if (watchDescriptor == -1) //probably out of watches, files in this directory can't be cached
+		return false;
+
+	//"a/" and "./a/" are the same directory, inotify hands out the same descriptor for both
+	mWatchDescriptors[prefix] = watchDescriptor;
+	mWatchedDirectories[watchDescriptor].push_back(std::move(prefix));
+
+	return true;
+}
+
+void FileCache::watcherProcedure(std::stop_token stopToken)
+{
+	alignas(inotify_event) char buffer[4096];
+	pollfd descriptor = { mNotifier, POLLIN, 0 };
+
+	while (!stopToken.stop_requested())
+	{
+		if (poll(&descriptor, 1, 500) <= 0)
+			continue;
+
+		ssize_t length = read(mNotifier, buffer, sizeof(buffer));
+
+		for (char *position = buffer; length > 0 && position < buffer + length;)
+		{
+			const inotify_event *event = reinterpret_cast<const inotify_event*>(position);
+			std::vector<std::string> paths;
+
+			position += sizeof(inotify_event) + event->len;
+
+			if (event->mask & IN_Q_OVERFLOW) //events were lost, nothing in the cache can be trusted
+			{
+				clear();
+				continue;
+			}
+
+			{
+				std::lock_guard<std::mutex> lck(mWatchMutex);
+				auto directory = mWatchedDirectories.find(event->wd);
+
+				if (directory == mWatchedDirectories.end())
+					continue;
+
+				if (event->mask & IN_IGNORED) //directory was deleted or unmounted
+				{
+					for (const std::string &prefix : directory->second)
+						mWatchDescriptors.erase(prefix);
+					mWatchedDirectories.erase(directory);
+					continue;
+				}
+
+				if (!event->len)
+					continue;
+
+				for (const std::string &prefix : directory->second)
+					paths.push_back(prefix + event->name);
+			}
+
+			for (const std::string &path : paths)
+			{
+				invalidate(path);
+				if (path.ends_with(".gz"))
+					invalidate(std::string_view(path).substr(0, path.size() - 3));
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,86 @@
+#ifndef __FILECACHE__
+#define __FILECACHE__
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <optional>
+#include <thread>
+#include "File.h"
+
+//Keeps the contents and precomputed headers of small files in memory. Entries are split in shards by path, each one
+//with its own lock and LRU list, so worker threads looking up different files don't contend.
+//On linux entries are invalidated through inotify, elsewhere they're revalidated with a stat at most once per second.
+class FileCache
+{
+public:
+	struct Entry
+	{
+		std::vector<std::uint8_t> mContents;
+		std::optional<std::vector<std::uint8_t>> mCompressed; //contents of the .gz file next to it, if there's an up to date one
+		File::Status mStatus;
+		std::string mETag, mLastModified;
+		std::string_view mMimeType;
+
+		std::size_t getMemoryUsage() const noexcept;
+	};
+private:
+	static constexpr std::size_t shardCount = 16;
+
+	struct Slot
+	{
+		std::shared_ptr<const Entry> mEntry;
+		std::list<std::string>::iterator mRecency;
+		std::int64_t mValidatedAt; //steady clock seconds, only used where there's no inotify
+	};
+
+	struct Shard
+	{
+		std::mutex mMutex;
+		std::list<std::string> mRecency; //most recently used first
+		std::unordered_map<std::string, Slot> mEntries;
+		std::size_t mMemoryUsage = 0;
+		std::uint64_t mGeneration = 0; //bumped by every invalidation, files loaded while it changed aren't inserted
+	};
+
+	std::array<Shard, shardCount> mShards;
+	std::atomic<std::size_t> mShardBudget, mMaxFileSize;
+	#ifdef __linux__
+	int mNotifier;
+	std::mutex mWatchMutex;
+	std::unordered_map<int, std::vector<std::string>> mWatchedDirectories; //watch descriptor to directory prefixes, as they appear in cache keys
+	std::unordered_map<std::string, int> mWatchDescriptors;
+	std::jthread mWatcher;
+
+	bool watch(std::string_view path);
+	void watcherProcedure(std::stop_token);
+	#endif
+
+	Shard& getShard(std::string_view path);
+	std::shared_ptr<const Entry> load(std::string_view path) const;
+	void evict(Shard &shard);
+	void erase(Shard &shard, std::unordered_map<std::string, Slot>::iterator slot);
+public:
+	FileCache(std::size_t memoryBudget, std::size_t maxFileSize);
+	FileCache(const FileCache&) = delete;
+	FileCache& operator=(const FileCache&) = delete;
+	~FileCache();
+
+	//nullptr if the file doesn't exist or is too big to be cached. status is what the caller already knows about the file, from the
+	//descriptor cache, files it says are too big are turned down without opening or watching them.
+	std::shared_ptr<const Entry> get(std::string_view path, const File::Status &status);
+	void invalidate(std::string_view path);
+	void clear();
+	void setLimits(std::size_t memoryBudget, std::size_t maxFileSize) noexcept;
+
+	//process wide cache used by StaticFileHandler
+	static FileCache& getInstance();
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "FileDescriptorCache.h"
+#include <functional>
+#include <algorithm>
+#include <system_error>
+
+FileDescriptorCache::FileDescriptorCache(std::chrono::milliseconds timeToLive, std::size_t maxEntries)
+	:mTimeToLive(std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeToLive).count()),
+	mMaxShardEntries(std::max<std::size_t>(maxEntries / shardCount, 1))
+{}
+
+FileDescriptorCache::Shard& FileDescriptorCache::getShard(std::string_view path)
+{
+	return mShards[std::hash<std::string_view>()(path) % shardCount];
+}
+
+void FileDescriptorCache::insert(Shard &shard, std::string path, std::shared_ptr<const File> file, std::chrono::steady_clock::time_point now)
+{
+	auto slot = shard.mEntries.find(path);
+
+	if (slot != shard.mEntries.end()) //another thread opened it first
+	{
+		slot->second.mFile = std::move(file);
+		slot->second.mValidatedAt = now;
+		shard.mRecency.splice(shard.mRecency.begin(), shard.mRecency, slot->second.mRecency);
+		return;
+	}
+
+	shard.mRecency.push_front(path);
+	shard.mEntries.emplace(std::move(path), Slot { std::move(file), shard.mRecency.begin(), now });
+
+	while (shard.mEntries.size() > mMaxShardEntries.load(std::memory_order_relaxed))
+	{
+		shard.mEntries.erase(shard.mRecency.back());
+		shard.mRecency.pop_back();
+	}
+}
+
+std::shared_ptr<const File> FileDescriptorCache::open(std::string_view path)
+{
+	Shard &shard = getShard(path);
+	std::string key(path);
+	std::shared_ptr<const File> file;
+	auto now = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lck(shard.mMutex);
+		auto slot = shard.mEntries.find(key);
+
+		if (slot != shard.mEntries.end())
+		{
+			shard.mRecency.splice(shard.mRecency.begin(), shard.mRecency, slot->second.mRecency);
+			if (now - slot->second.mValidatedAt < std::chrono::steady_clock::duration(mTimeToLive.load(std::memory_order_relaxed)))
+				return slot->second.mFile;
+			file = slot->second.mFile;
+		}
+	}
+
+	try
+	{
+		//a stat is cheaper than opening the file again, and is all that's needed if nothing changed
+		if (file && File::stat(path) == file->getStatus())
+		{
+			std::lock_guard<std::mutex> lck(shard.mMutex);
+			auto slot = shard.mEntries.find(key);
+
+			if (slot != shard.mEntries.end() && slot->second.mFile == file)
+				slot->second.mValidatedAt = now;
+
+			return file;
+		}
+
+		file = std::make_shared<const File>(path);
+	}
+	catch (const std::system_error&)
+	{
+		std::lock_guard<std::mutex> lck(shard.mMutex);
+		auto slot = shard.mEntries.find(key);
+
+		if (slot != shard.mEntries.end())
+		{
+			shard.mRecency.erase(slot->second.mRecency);
+			shard.mEntries.erase(slot);
+		}
+		throw;
+	}
+
+	std::lock_guard<std::mutex> lck(shard.mMutex);
+	insert(shard, std::move(key), file, now);
+
+	return file;
+}
+
+void FileDescriptorCache::setLimits(std::chrono::milliseconds timeToLive, std::size_t maxEntries) noexcept
+{
+	mTimeToLive.store(std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeToLive).count(), std::memory_order_relaxed);
+	mMaxShardEntries.store(std::max<std::size_t>(maxEntries / shardCount, 1), std::memory_order_relaxed);
+}
+
+FileDescriptorCache& FileDescriptorCache::getInstance()
+{
+	static FileDescriptorCache instance(std::chrono::seconds(2), 1024);
+
+	return instance;
+}
@@ -0,0 +1,54 @@
+#ifndef __FILEDESCRIPTORCACHE__
+#define __FILEDESCRIPTORCACHE__
+#include <string>
+#include <string_view>
+#include <list>
+#include <unordered_map>
+#include <array>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include "File.h"
+
+//Keeps files open between requests so serving them doesn't cost an open/fstat/close every time. Files are handed out
+//reference counted, an evicted or replaced file stays open until the last response using it is done with it.
+//Entries older than the time to live are revalidated with a stat, and reopened if the file changed.
+class FileDescriptorCache
+{
+	static constexpr std::size_t shardCount = 16;
+
+	struct Slot
+	{
+		std::shared_ptr<const File> mFile;
+		std::list<std::string>::iterator mRecency;
+		std::chrono::steady_clock::time_point mValidatedAt;
+	};
+
+	struct Shard
+	{
+		std::mutex mMutex;
+		std::list<std::string> mRecency; //most recently used first
+		std::unordered_map<std::string, Slot> mEntries;
+	};
+
+	std::array<Shard, shardCount> mShards;
+	std::atomic<std::chrono::steady_clock::duration::rep> mTimeToLive;
+	std::atomic<std::size_t> mMaxShardEntries;
+
+	Shard& getShard(std::string_view path);
+	void insert(Shard &shard, std::string path, std::shared_ptr<const File> file, std::chrono::steady_clock::time_point now);
+public:
+	FileDescriptorCache(std::chrono::milliseconds timeToLive, std::size_t maxEntries);
+	FileDescriptorCache(const FileDescriptorCache&) = delete;
+	FileDescriptorCache& operator=(const FileDescriptorCache&) = delete;
+
+	//throws std::system_error if the file can't be opened
+	std::shared_ptr<const File> open(std::string_view path);
+	void setLimits(std::chrono::milliseconds timeToLive, std::size_t maxEntries) noexcept;
+
+	//process wide cache used by Response::sendFile and StaticFileHandler
+	static FileDescriptorCache& getInstance();
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include <array>
+#include <algorithm>
+#include <charconv>
+#include <ctime>
+#include <cctype>
+#include "FileMetadata.h"
+
+namespace
+{
+	//sorted by extension so it can be binary searched
+	constexpr std::array<std::pair<std::string_view, std::string_view>, 34> mimeTypes = { {
+		{ "avif", "image/avif" },
+		{ "bmp", "image/bmp" },
+		{ "css", "text/css; charset=utf-8" },
+		{ "csv", "text/csv; charset=utf-8" },
+		{ "gif", "image/gif" },
+		{ "gz", "application/gzip" },
+		{ "htm", "text/html; charset=utf-8" },
+		{ "html", "text/html; charset=utf-8" },
+		{ "ico", "image/x-icon" },
+		{ "jpeg", "image/jpeg" },
+		{ "jpg", "image/jpeg" },
+		{ "js", "text/javascript; charset=utf-8" },
+		{ "json", "application/json" },
+		{ "m4a", "audio/mp4" },
+		{ "map", "application/json" },
+		{ "mjs", "text/javascript; charset=utf-8" },
+		{ "mp3", "audio/mpeg" },
+		{ "mp4", "video/mp4" },
+		{ "oga", "audio/ogg" },
+		{ "ogv", "video/ogg" },
+		{ "otf", "font/otf" },
+		{ "pdf", "application/pdf" },
+		{ "png", "image/png" },
+		{ "svg", "image/svg+xml" },
+		{ "ttf", "font/ttf" },
+		{ "txt", "text/plain; charset=utf-8" },
+		{ "wasm", "application/wasm" },
+		{ "wav", "audio/wav" },
+		{ "webm", "video/webm" },
+		{ "webmanifest", "application/manifest+json" },
+		{ "webp", "image/webp" },
+		{ "woff", "font/woff" },
+		{ "woff2", "font/woff2" },
+		{ "xml", "application/xml" }
+	} };
+
+	static_assert(std::is_sorted(mimeTypes.begin(), mimeTypes.end()), "mimeTypes must be sorted by extension");
+}
+
+std::string_view getMimeType(std::string_view path)
+{
+	constexpr std::size_t maxExtensionLength = 16;
+	std::array<char, maxExtensionLength> extension;
+	auto dot = path.rfind('.'), slash = path.find_last_of("/\\");
+
+	if (dot == std::string_view::npos || (slash != std::string_view::npos && dot < slash) || path.size() - dot - 1 > maxExtensionLength)
+		return "application/octet-stream";
+
+	std::string_view rawExtension = path.substr(dot + 1);
+	std::transform(rawExtension.begin(), rawExtension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+	std::string_view lowerExtension(extension.data(), rawExtension.size());
+	auto it = std::lower_bound(mimeTypes.begin(), mimeTypes.end(), lowerExtension, [](const auto &entry, std::string_view value) { return entry.first < value; });
+
+	return it != mimeTypes.end() && it->first == lowerExtension ? it->second : "application/octet-stream";
+}
+
+//FNV-1a over size, modification time and identity
+std::string makeETag(const File::Status &status)
+{
+	constexpr std::uint64_t offsetBasis = 14695981039346656037ull, prime = 1099511628211ull;
+	std::uint64_t hash = offsetBasis;
+	std::array<std::uint64_t, 3> fields = { status.size, static_cast<std::uint64_t>(status.lastWriteTime), status.identity };
+	std::array<char, 16> digits;
+
+	for (std::uint64_t field : fields)
+	{
+		for (int i = 0; i < 8; ++i)
+		{
+			hash ^= (field >> (i * 8)) & 0xFF;
+			hash *= prime;
+		}
+	}
+
+	auto end = std::to_chars(digits.data(), digits.data() + digits.size(), hash, 16).ptr;
+
+	return '"' + std::string(digits.data(), end) + '"';
+}
+
+std::string formatHttpDate(std::int64_t time)
+{
+	std::time_t seconds = static_cast<std::time_t>(time);
+	std::tm brokenDown;
+	std::array<char, 32> result;
+
+	#ifdef _WIN32
+	gmtime_s(&brokenDown, &seconds);
+	#elif defined(__linux__)
+	gmtime_r(&seconds, &brokenDown);
+	#endif
+
+	return std::string(result.data(), std::strftime(result.data(), result.size(), "%a, %d %b %Y %H:%M:%S GMT", &brokenDown));
+}
+
+//only IMF-fixdate is accepted (Sun, 06 Nov 1994 08:49:37 GMT), the obsolete formats just make the validator fail
+std::optional<std::int64_t> parseHttpDate(std::string_view date)
+{
+	constexpr std::array<std::string_view, 12> months = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	std::tm brokenDown = {};
+	auto number = [date](std::size_t position, std::size_t length, int &value) {
+		return position + length <= date.size() && std::from_chars(date.data() + position, date.data() + position + length, value).ec == std::errc();
+	};
+
+	if (date.size() != 29 || date.substr(25) != " GMT")
+		return std::optional<std::int64_t>();
+
+	auto month = std::find(months.begin(), months.end(), date.substr(8, 3));
+
+	if (month == months.end() || !number(5, 2, brokenDown.tm_mday) || !number(12, 4, brokenDown.tm_year) || !number(17, 2, brokenDown.tm_hour) || !number(20, 2, brokenDown.tm_min) || !number(23, 2, brokenDown.tm_sec))
+		return std::optional<std::int64_t>();
+
+	brokenDown.tm_mon = static_cast<int>(month - months.begin());
+	brokenDown.tm_year -= 1900;
+
+	#ifdef _WIN32
+	return _mkgmtime(&brokenDown);
+	#elif defined(__linux__)
+	return timegm(&brokenDown);
+	#endif
+}
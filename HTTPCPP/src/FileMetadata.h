@@ -0,0 +1,16 @@
+#ifndef __FILEMETADATA__
+#define __FILEMETADATA__
+#include <string>
+#include <string_view>
+#include <optional>
+#include <cstdint>
+#include "File.h"
+
+//MIME type for the extension of path, application/octet-stream if it's unknown
+std::string_view getMimeType(std::string_view path);
+//strong validator built from the file metadata, so computing it never touches the contents
+std::string makeETag(const File::Status &status);
+std::string formatHttpDate(std::int64_t time);
+std::optional<std::int64_t> parseHttpDate(std::string_view date);
+
+#endif
@@ -3,6 +3,12 @@
 #include <string>
 #include <array>
 #include <regex>
+#include <algorithm>
+#include <type_traits>
+#include <charconv>
+#include <cctype>
+#include <utility>
+#include <memory_resource>
 #include "HttpRequest.h"
 #include "Common.h"
 #include "Socket.h"
@@ -25,24 +31,26 @@ inline void Sleep(size_t miliseconds)
 class Http::Request::Impl
 {
 public:
-	static std::regex requestHeaderFormat, requestLineFormat, queryStringFormat, queryStringParams;
-	std::string mMethod;
-	std::string mResource;
-	std::string mVersion;
-	std::map<std::string, std::string, decltype(CaseInsensitiveComparator)*> mFields;
-	std::vector<std::uint8_t> mBody;
-	std::unordered_map<std::string, std::string> queryStringArguments;
-	std::shared_ptr<Socket> mSock;
+	static constexpr std::size_t headerReceiveSize = 4 * 1024; //received at a time until the header ends, the whole header of nearly every request
+	static std::regex requestLineFormat, queryStringFormat;
+	std::pmr::polymorphic_allocator<> mAllocator; //the request's arena, or the heap for requests built outside of the server
+	Method mMethod = Method::Other;
+	std::pmr::string mMethodText; //only set for Method::Other
+	std::pmr::string mResource;
+	std::pmr::string mVersion;
+	std::pmr::map<std::pmr::string, std::pmr::string, CaseInsensitiveLess> mFields;
+	std::pmr::vector<std::uint8_t> mBody;
+	std::pmr::map<std::pmr::string, std::pmr::string, std::less<>> queryStringArguments;
+	std::pmr::vector<std::pair<std::string_view, std::string_view>> mPathParameters; //views into mResource and the route pattern
+	Socket &mSock; //owned by the connection
 
 	static const char* getFieldText(HeaderField field);
 	HeaderField getFieldId(const std::string_view &field);
-	Impl(std::shared_ptr<Socket> mSock);
+	static Method getMethodId(std::string_view method);
+	static void destroy(Impl *impl) noexcept;
+	Impl(Socket &socket, std::pmr::polymorphic_allocator<> allocator);
 };
 
-//[1]: header field
-//[2]: header value
-std::regex Http::Request::Impl::requestHeaderFormat("([^:]+):[[:space:]]?(.+)\r\n");
-
 //[1]: method
 //[2]: resource
 //[3]: version
@@ -51,10 +59,6 @@ std::regex Http::Request::Impl::requestLineFormat("([[:upper:]]+) (/[^[:space:]]
 //[1]: first parameter
 std::regex Http::Request::Impl::queryStringFormat(".+[^/](\\?[^\\?/[:space:]&=]+)=(?:[^\\?/[:space:]&=]+)(?:&(?:[^\\?/[:space:]&=]+)=(?:[^\\?/[:space:]&=]+))*");
 
-//[1]: parameter
-//[2]: value
-std::regex Http::Request::Impl::queryStringParams("([^\\?/[:space:]&=]+)=([^\\?/[:space:]&=]+)");
-
 const char* Http::Request::Impl::getFieldText(HeaderField field)
 {
 	switch (field)
@@ -197,56 +201,84 @@ Http::Request::HeaderField Http::Request::Impl::getFieldId(const std::string_vie
 	return result;
 }
 
-Http::Request::Impl::Impl(std::shared_ptr<Socket> sockWrapper)
-	:mSock(sockWrapper),
-	mFields(CaseInsensitiveComparator)
+Http::Request::Method Http::Request::Impl::getMethodId(std::string_view method)
+{
+	//methods are case sensitive and few, comparing against each one is cheaper than hashing
+	for (std::underlying_type_t<Method> i = 0; i < static_cast<std::underlying_type_t<Method>>(Method::Other); ++i)
+		if (method == Request::getMethodText(static_cast<Method>(i)))
+			return static_cast<Method>(i);
+
+	return Method::Other;
+}
+
+void Http::Request::Impl::destroy(Impl *impl) noexcept
+{
+	if (impl)
+	{
+		std::pmr::polymorphic_allocator<> allocator = impl->mAllocator;
+		allocator.delete_object(impl);
+	}
+}
+
+Http::Request::Impl::Impl(Socket &socket, std::pmr::polymorphic_allocator<> allocator)
+	:mAllocator(allocator),
+	mMethodText(allocator),
+	mResource(allocator),
+	mVersion(allocator),
+	mFields(allocator),
+	mBody(allocator),
+	queryStringArguments(allocator),
+	mPathParameters(allocator),
+	mSock(socket)
 {
 	using std::string;
 	using std::array;
 	using std::regex_search;
 
-	#ifdef _WIN32
-	int flags = 0;
-	//mSock->toggleNonBlockingMode(false);
-	//NonBlockingSocket nonBlocking(*mSock);
-	#elif defined(__linux__)
-	int flags = MSG_DONTWAIT;
-	#endif
+	constexpr int flags = 0; //the rest of a request that arrives in pieces is waited for, up to the socket's receive timeout
 
-	unsigned contentLength;
-	string requestText;
+	unsigned contentLength = 0;
+	std::pmr::string requestText(allocator);
 	string::size_type headerEnd = string::npos;
-	std::smatch requestLineMatch, queryStringMatch;
+	std::pmr::cmatch requestLineMatch(allocator), queryStringMatch(allocator);
 	
+	//received straight into the arena, the string only grows for headers longer than what it holds
 	do
 	{
-		auto aux = mSock->receive(flags);
+		std::size_t received = requestText.size();
 
-		if (aux.empty())
-		{
-			if (headerEnd == std::string::npos)
-				throw RequestException("Invalid request");
-		}
-		else
-		{
-			requestText += aux;
-			headerEnd = requestText.find("\r\n\r\n"); //header end could be split between aux and requestText, so I can't just find it in aux
-		}
+		requestText.resize(std::max(requestText.capacity() > received ? requestText.capacity() : received + headerReceiveSize, headerReceiveSize));
+		requestText.resize(received + static_cast<std::size_t>(mSock.receive(requestText.data() + received, requestText.size() - received, flags)));
+
+		if (requestText.size() == received)
+			throw RequestException("Invalid request");
+		headerEnd = requestText.find("\r\n\r\n", received < 3 ? 0 : received - 3); //the header end could be split between this receive and the last
 	} while (headerEnd == string::npos);
 
 	if (headerEnd == string::npos)
 		throw RequestException("Header doesn't end");
 
-	if (regex_search(requestText, requestLineMatch, requestLineFormat))
+	if (regex_search(std::as_const(requestText).data(), std::as_const(requestText).data() + requestText.size(), requestLineMatch, requestLineFormat))
 	{
-		mMethod = requestLineMatch[1];
-		mResource = requestLineMatch[2];
-		mVersion = requestLineMatch[3];
+		auto view = [](const auto &match) { return std::string_view(match.first, match.length()); };
+
+		mMethod = getMethodId(view(requestLineMatch[1]));
+		if (mMethod == Method::Other)
+			mMethodText = view(requestLineMatch[1]);
+		mResource = view(requestLineMatch[2]);
+		mVersion = view(requestLineMatch[3]);
 
-		if (regex_match(mResource, queryStringMatch, queryStringFormat))
+		if (mResource.find('?') != std::string::npos && regex_match(std::as_const(mResource).data(), std::as_const(mResource).data() + mResource.size(), queryStringMatch, queryStringFormat))
 		{
-			for (std::sregex_iterator it(mResource.begin() + queryStringMatch.position(1), mResource.end(), queryStringParams), end; it != end; ++it)
-				queryStringArguments[(*it)[1]] = (*it)[2];
+			//the format is validated already, key=value pairs separated by & follow the ?
+			for (std::string_view query = std::string_view(mResource).substr(queryStringMatch.position(1) + 1); !query.empty();)
+			{
+				std::string_view pair = query.substr(0, query.find('&'));
+				auto equals = pair.find('=');
+
+				queryStringArguments.insert_or_assign(std::pmr::string(pair.substr(0, equals), allocator), pair.substr(equals + 1));
+				query.remove_prefix(std::min(pair.size() + 1, query.size()));
+			}
 
 			mResource.erase(mResource.begin() + queryStringMatch.position(1), mResource.end());
 		}
@@ -254,28 +286,42 @@ Http::Request::Impl::Impl(std::shared_ptr<Socket> sockWrapper)
 	else
 		throw RequestException("Request line is malformed");
 
-	for (std::sregex_iterator i(requestText.begin() + requestLineMatch[0].str().size(), requestText.end(), requestHeaderFormat), end; i != end; ++i)
-		mFields[(*i)[1]] = (*i)[2];
+	//"Field: value" lines up to the empty one, split by hand because iterating a regex over them allocates for every line
+	for (std::string_view fields(requestText.data() + requestLineMatch.length(0), headerEnd + 2 - requestLineMatch.length(0)); !fields.empty();)
+	{
+		std::string_view line = fields.substr(0, fields.find("\r\n"));
+		auto colon = line.find(':');
 
-	try {
-		contentLength = std::stoul(mFields.at(getFieldText(HeaderField::ContentLength)));
-	}
-	catch (const std::invalid_argument&) {
-		contentLength = 0;
-	}
-	catch (const std::out_of_range&) {
-		contentLength = 0;
+		fields.remove_prefix(std::min(line.size() + 2, fields.size()));
+		if (colon == std::string_view::npos || !colon)
+			continue;
+
+		std::string_view value = line.substr(colon + 1);
+
+		if (!value.empty() && std::isspace(static_cast<unsigned char>(value.front())))
+			value.remove_prefix(1);
+		if (!value.empty())
+			mFields.insert_or_assign(std::pmr::string(line.substr(0, colon), allocator), value);
 	}
 
+	if (auto field = mFields.find(getFieldText(HeaderField::ContentLength)); field != mFields.end())
+		if (std::from_chars(field->second.data(), field->second.data() + field->second.size(), contentLength).ec != std::errc())
+			contentLength = 0;
+
 	if (contentLength)
 	{
-		mBody.insert(mBody.begin(), requestText.begin() + headerEnd + 4, requestText.end());
+		std::size_t received = std::min<std::size_t>(requestText.size() - headerEnd - 4, contentLength);
+
+		mBody.resize(contentLength);
+		std::copy_n(requestText.begin() + headerEnd + 4, received, mBody.begin());
 
-		while (mBody.size() < contentLength)
+		while (received < contentLength)
 		{
-			auto aux = mSock->receive(flags);
+			auto length = mSock.receive(mBody.data() + received, contentLength - received, flags);
 
-			mBody.insert(mBody.end(), aux.begin(), aux.end());
+			if (!length)
+				throw RequestException("Body is incomplete");
+			received += static_cast<std::size_t>(length);
 		}
 	}
 }
@@ -286,13 +332,17 @@ Http::Request::Impl::Impl(std::shared_ptr<Socket> sockWrapper)
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-Http::Request::Request(std::shared_ptr<Socket> sockWrapper)
-	:mThis(new Impl(sockWrapper))
+Http::Request::Request(Socket &socket)
+	:Request(socket, std::pmr::new_delete_resource())
+{}
+
+Http::Request::Request(Socket &socket, std::pmr::memory_resource *resource)
+	:mThis(std::pmr::polymorphic_allocator<>(resource).new_object<Impl>(socket, resource))
 {}
 
 Http::Request::~Request() noexcept
 {
-	delete mThis;
+	Impl::destroy(mThis);
 }
 
 Http::Request::Request(Request &&other) noexcept
@@ -303,7 +353,7 @@ Http::Request::Request(Request &&other) noexcept
 
 Http::Request& Http::Request::operator=(Request &&other) noexcept
 {
-	delete mThis;
+	Impl::destroy(mThis);
 	mThis = other.mThis;
 	other.mThis = nullptr;
 
@@ -311,6 +361,11 @@ Http::Request& Http::Request::operator=(Request &&other) noexcept
 }
 
 std::string_view Http::Request::getMethod()
+{
+	return mThis->mMethod == Method::Other ? std::string_view(mThis->mMethodText) : getMethodText(mThis->mMethod);
+}
+
+Http::Request::Method Http::Request::getMethodId()
 {
 	return mThis->mMethod;
 }
@@ -327,32 +382,35 @@ std::string_view Http::Request::getVersion()
 
 std::optional<std::string_view> Http::Request::getField(HeaderField field)
 {
-	try {
-		return mThis->mFields.at(mThis->getFieldText(field));
-	}
-	catch (const std::out_of_range&) {
-		return std::optional<std::string_view>();
-	}
+	const char *text = mThis->getFieldText(field);
+
+	return text ? getField(std::string_view(text)) : std::optional<std::string_view>();
 }
 
 std::optional<std::string_view> Http::Request::getField(std::string_view field)
 {
-	try {
-		return mThis->mFields.at(field.data());
-	}
-	catch (const std::out_of_range&) {
-		return std::optional<std::string_view>();
-	}
+	auto value = mThis->mFields.find(field);
+
+	return value != mThis->mFields.end() ? std::string_view(value->second) : std::optional<std::string_view>();
 }
 
 std::optional<std::string_view> Http::Request::getRequestStringValue(std::string_view key)
 {
-	try {
-		return mThis->queryStringArguments.at(key.data());
-	}
-	catch (const std::out_of_range&) {
-		return std::optional<std::string_view>();
-	}
+	auto value = mThis->queryStringArguments.find(key);
+
+	return value != mThis->queryStringArguments.end() ? std::string_view(value->second) : std::optional<std::string_view>();
+}
+
+std::optional<std::string_view> Http::Request::getPathParameter(std::string_view name)
+{
+	auto parameter = std::find_if(mThis->mPathParameters.begin(), mThis->mPathParameters.end(), [name](const auto &pair) { return pair.first == name; });
+
+	return parameter != mThis->mPathParameters.end() ? parameter->second : std::optional<std::string_view>();
+}
+
+void Http::Request::setPathParameters(std::span<const std::pair<std::string_view, std::string_view>> parameters)
+{
+	mThis->mPathParameters.assign(parameters.begin(), parameters.end());
 }
 
 std::vector<std::string_view> Http::Request::getRequestStringKeys()
@@ -366,7 +424,34 @@ std::vector<std::string_view> Http::Request::getRequestStringKeys()
 	return result;
 }
 
-const std::vector<std::uint8_t>& Http::Request::getBody()
+std::span<const std::uint8_t> Http::Request::getBody()
 {
 	return mThis->mBody;
+}
+
+const char* Http::Request::getMethodText(Method method) noexcept
+{
+	switch (method)
+	{
+		case Method::Get:
+			return "GET";
+		case Method::Head:
+			return "HEAD";
+		case Method::Post:
+			return "POST";
+		case Method::Put:
+			return "PUT";
+		case Method::Delete:
+			return "DELETE";
+		case Method::Connect:
+			return "CONNECT";
+		case Method::Options:
+			return "OPTIONS";
+		case Method::Trace:
+			return "TRACE";
+		case Method::Patch:
+			return "PATCH";
+		default:
+			return nullptr;
+	}
 }
\ No newline at end of file
@@ -1,10 +1,12 @@
 #include <string>
 #include <map>
 #include <vector>
+#include <memory_resource>
 #include <stdexcept>
 #include "HttpResponse.h"
 #include "Common.h"
 #include "Socket.h"
+#include "FileDescriptorCache.h"
 #ifdef __linux__
 #include <cstring>
 #endif
@@ -12,14 +14,24 @@
 class Http::Response::Impl
 {
 public:
-	std::map<std::string, std::string, decltype(CaseInsensitiveComparator)*> mFields;
-	std::string mVersion;
-	std::vector<uint8_t> mBody;
-	std::shared_ptr<Socket> mSock;
+	std::pmr::polymorphic_allocator<> mAllocator; //the request's arena, or the heap for responses built outside of the server
+	std::pmr::map<std::pmr::string, std::pmr::string, CaseInsensitiveLess> mFields;
+	std::pmr::string mVersion;
+	std::pmr::vector<uint8_t> mBody;
+	Socket &mSock; //owned by the connection
 	std::optional<std::uint16_t> mStatusCode;
+	bool mCorked = false;
+	bool mBodySuppressed = false;
+	std::string *mCapture = nullptr;
 
 	static const char* getFieldText(HeaderField field);
-	Impl(std::shared_ptr<Socket>);
+	static void destroy(Impl *impl) noexcept;
+	void setField(std::string_view field, std::string_view value);
+	std::optional<std::string_view> getField(std::string_view field) const;
+	std::pmr::string serializeHeaders() const;
+	void write(const void *data, std::size_t size);
+	Impl(Socket&, std::pmr::polymorphic_allocator<>);
+	~Impl();
 };
 
 const char* Http::Response::Impl::getFieldText(HeaderField field)
@@ -123,12 +135,110 @@ const char* Http::Response::Impl::getFieldText(HeaderField field)
 	}
 }
 
-Http::Response::Impl::Impl(std::shared_ptr<Socket> sock)
-	:mSock(sock)
-	,mVersion("1.1")
-	,mFields(CaseInsensitiveComparator)
+Http::Response::Impl::Impl(Socket &sock, std::pmr::polymorphic_allocator<> allocator)
+	:mAllocator(allocator)
+	,mFields(allocator)
+	,mVersion("1.1", allocator)
+	,mBody(allocator)
+	,mSock(sock)
 {}
 
+void Http::Response::Impl::destroy(Impl *impl) noexcept
+{
+	if (impl)
+	{
+		std::pmr::polymorphic_allocator<> allocator = impl->mAllocator;
+		allocator.delete_object(impl);
+	}
+}
+
+void Http::Response::Impl::setField(std::string_view field, std::string_view value)
+{
+	auto existing = mFields.find(field);
+
+	if (existing != mFields.end())
+		existing->second = value;
+	else
+		mFields.emplace(field, value);
+}
+
+std::optional<std::string_view> Http::Response::Impl::getField(std::string_view field) const
+{
+	auto value = mFields.find(field);
+
+	return value != mFields.end() ? std::string_view(value->second) : std::optional<std::string_view>();
+}
+
+std::pmr::string Http::Response::Impl::serializeHeaders() const
+{
+	constexpr const char *fieldEnd = "\r\n";
+	std::pmr::string response(mAllocator);
+
+	response += "HTTP/";
+	response += mVersion;
+	response += ' ';
+	response += std::to_string(mStatusCode.value()); //short enough for the small string buffer
+	response += fieldEnd;
+
+	for (const auto &fieldValue : mFields)
+	{
+		if (mCapture && !CaseInsensitiveComparator(fieldValue.first, "Connection") && !CaseInsensitiveComparator("Connection", fieldValue.first))
+			continue; //captured responses are replayed to other connections, which negotiate their own
+		response += fieldValue.first;
+		response += ": ";
+		response += fieldValue.second;
+		response += fieldEnd;
+	}
+
+	response += fieldEnd;
+
+	return response;
+}
+
+void Http::Response::Impl::write(const void *data, std::size_t size)
+{
+	std::int64_t bytesSent = 0;
+
+	if (mCapture)
+	{
+		mCapture->append(static_cast<const char*>(data), size);
+		return;
+	}
+
+	while (bytesSent < static_cast<decltype(bytesSent)>(size))
+	{
+		decltype(bytesSent) auxBytesSent = mSock.send(static_cast<const char*>(data) + bytesSent, size - bytesSent, 0);
+
+		if (auxBytesSent > 0)
+			bytesSent += auxBytesSent;
+		else
+		{
+			#ifdef _WIN32
+			LPSTR message;
+			FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, NULL, WSAGetLastError(), MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&message, 0, NULL);
+			std::string strMsg(message);
+			LocalFree(message);
+			throw ResponseException(strMsg);
+			#elif defined(__linux__)
+			throw ResponseException(std::strerror(errno));
+			#endif
+		}
+	}
+}
+
+Http::Response::Impl::~Impl()
+{
+	if (mCorked)
+	{
+		try
+		{
+			mSock.setCork(false); //flush whatever is left of the last segment
+		}
+		catch (const SocketException&)
+		{}
+	}
+}
+
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -136,13 +246,17 @@ Http::Response::Impl::Impl(std::shared_ptr<Socket> sock)
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-Http::Response::Response(std::shared_ptr<Socket> wrapper)
-	:mThis(new Impl(wrapper))
+Http::Response::Response(Socket &wrapper)
+	:Response(wrapper, std::pmr::new_delete_resource())
+{}
+
+Http::Response::Response(Socket &wrapper, std::pmr::memory_resource *resource)
+	:mThis(std::pmr::polymorphic_allocator<>(resource).new_object<Impl>(wrapper, resource))
 {}
 
 Http::Response::~Response() noexcept
 {
-	delete mThis;
+	Impl::destroy(mThis);
 }
 
 Http::Response::Response(Response &&other) noexcept
@@ -153,7 +267,7 @@ Http::Response::Response(Response &&other) noexcept
 
 Http::Response& Http::Response::operator=(Response &&other) noexcept
 {
-	delete mThis;
+	Impl::destroy(mThis);
 	mThis = other.mThis;
 	other.mThis = nullptr;
 
@@ -162,12 +276,12 @@ Http::Response& Http::Response::operator=(Response &&other) noexcept
 
 void Http::Response::setBody(const std::vector<std::uint8_t> &newBody)
 {
-	mThis->mBody = newBody;
+	mThis->mBody.assign(newBody.begin(), newBody.end());
 }
 
 void Http::Response::setBody(std::string_view body)
 {
-	mThis->mBody = decltype(Impl::mBody)(body.begin(), body.end());
+	mThis->mBody.assign(body.begin(), body.end());
 }
 
 void Http::Response::setStatusCode(std::uint16_t code)
@@ -177,83 +291,87 @@ void Http::Response::setStatusCode(std::uint16_t code)
 
 void Http::Response::setField(HeaderField field, std::string_view value)
 {
-	mThis->mFields[mThis->getFieldText(field)] = value;
+	mThis->setField(mThis->getFieldText(field), value);
 }
 
 void Http::Response::setField(std::string_view field, std::string_view value)
 {
-	mThis->mFields[field.data()] = value;
+	mThis->setField(field, value);
 }
 
 std::optional<std::string_view> Http::Response::getField(HeaderField field)
 {
-	try
-	{
-		return mThis->mFields.at(mThis->getFieldText(field));
-	}
-	catch (const std::out_of_range&)
-	{
-		return std::optional<std::string_view>();
-	}
+	return mThis->getField(mThis->getFieldText(field));
 }
 
 std::optional<std::string_view> Http::Response::getField(std::string_view field)
 {
-	try
-	{
-		return mThis->mFields.at(field.data());
-	}
-	catch (const std::out_of_range&)
-	{
-		return std::optional<std::string_view>();
-	}
+	return mThis->getField(field);
 }
 
 void Http::Response::sendHeaders()
 {
 	if (!mThis->mStatusCode)
 		throw ResponseException("No status code set");
-	constexpr const char *fieldEnd = "\r\n";
-	std::string response = "HTTP/" + mThis->mVersion + ' ' + std::to_string(mThis->mStatusCode.value()) + fieldEnd;
-	std::int64_t bytesSent = 0;
+	std::pmr::string response = mThis->serializeHeaders();
 
-	for (const auto &fieldValue : mThis->mFields)
+	if (!mThis->mCorked && !mThis->mCapture)
 	{
-		response += fieldValue.first;
-		response += ": ";
-		response += fieldValue.second;
-		response += fieldEnd;
+		//headers are usually followed by small sendBytes calls, hold them back until the response ends
+		mThis->mSock.setCork(true);
+		mThis->mCorked = true;
 	}
 
-	response += fieldEnd;
+	mThis->write(response.data(), response.size());
+}
+
+void Http::Response::sendBytes(const std::vector<std::uint8_t> &bytes)
+{
+	sendBytes(std::span<const std::uint8_t>(bytes));
+}
+
+void Http::Response::sendBytes(std::span<const std::uint8_t> bytes)
+{
+	if (mThis->mBodySuppressed)
+		return;
+
+	mThis->write(bytes.data(), bytes.size());
+}
+
+void Http::Response::sendFile(std::string_view path, std::uint64_t offset, std::uint64_t count)
+{
+	if (mThis->mBodySuppressed)
+		return;
+
+	sendFile(*FileDescriptorCache::getInstance().open(path), offset, count);
+}
+
+void Http::Response::sendFile(const File &file, std::uint64_t offset, std::uint64_t count)
+{
+	if (mThis->mBodySuppressed)
+		return;
 
-	while (bytesSent < static_cast<decltype(bytesSent)>(response.size()))
+	if (mThis->mCapture)
 	{
-		decltype(bytesSent) auxBytesSent = mThis->mSock->send(response.data() + bytesSent, response.size() - bytesSent, 0);
+		std::size_t start = mThis->mCapture->size(), bytesRead = 0;
 
-		if (auxBytesSent > 0)
-			bytesSent += auxBytesSent;
-		else
+		mThis->mCapture->resize(start + count);
+		while (bytesRead < count)
 		{
-			#ifdef _WIN32
-			LPSTR message;
-			FormatMessageA(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_IGNORE_INSERTS, NULL, WSAGetLastError(), MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT), (LPSTR)&message, 0, NULL);
-			std::string strMsg(message);
-			LocalFree(message);
-			throw ResponseException(strMsg);
-			#elif defined(__linux__)
-			throw ResponseException(std::strerror(errno));
-			#endif
+			std::size_t aux = file.read(mThis->mCapture->data() + start + bytesRead, count - bytesRead, offset + bytesRead);
+
+			if (!aux)
+			{
+				mThis->mCapture->resize(start);
+				throw ResponseException("File is shorter than the range being sent");
+			}
+			bytesRead += aux;
 		}
+		return;
 	}
-}
 
-void Http::Response::sendBytes(const std::vector<std::uint8_t> &bytes)
-{
-	std::int64_t bytesSent = 0;
-
-	while (bytesSent < static_cast<decltype(bytesSent)>(bytes.size()))
-		bytesSent += mThis->mSock->send(const_cast<std::uint8_t*>(bytes.data()) + bytesSent, bytes.size() - bytesSent, 0);
+	if (mThis->mSock.sendFile(file, offset, count) != count)
+		throw ResponseException("File is shorter than the range being sent");
 }
 
 void Http::Response::send()
@@ -261,22 +379,20 @@ void Http::Response::send()
 	if (!mThis->mStatusCode)
 		throw ResponseException("No status code set");
 
-	constexpr const char *fieldEnd = "\r\n";
-	std::int64_t bytesSent = 0;
-	std::string response = "HTTP/" + mThis->mVersion + ' ' + std::to_string(mThis->mStatusCode.value()) + fieldEnd;
+	std::pmr::string response = mThis->serializeHeaders();
 
-	for (const auto &fieldValue : mThis->mFields)
-	{
-		response += fieldValue.first;
-		response += ": ";
-		response += fieldValue.second;
-		response += fieldEnd;
-	}
+	if (!mThis->mBodySuppressed)
+		response.insert(response.end(), mThis->mBody.begin(), mThis->mBody.end());
 
-	response += fieldEnd;
+	mThis->write(response.data(), response.size());
+}
 
-	response.insert(response.end(), mThis->mBody.begin(), mThis->mBody.end());
+void Http::Response::suppressBody() noexcept
+{
+	mThis->mBodySuppressed = true;
+}
 
-	while (bytesSent < static_cast<decltype(bytesSent)>(response.size()))
-		bytesSent += mThis->mSock->send(response.data() + bytesSent, response.size() - bytesSent, 0);
+void Http::Response::setCaptureBuffer(std::string *buffer) noexcept
+{
+	mThis->mCapture = buffer;
 }
\ No newline at end of file
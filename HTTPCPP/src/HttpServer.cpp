@@ -3,40 +3,277 @@
 #include <string>
 #include <algorithm>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <chrono>
 #include <future>
+#include <fstream>
+#include <cctype>
 #include "HttpServer.h"
 #include "HttpRequest.h"
 #include "HttpResponse.h"
 #include "ThreadPool.h"
 #include "Socket.h"
+#include "Router.h"
+#include "ResponseCache.h"
+#include "AdmissionControl.h"
+#include "Connection.h"
+#include "BufferPool.h"
+#include "Wakeup.h"
+#include "TLSContext.h"
 
 #ifdef _WIN32
+#include <Windows.h>
 #elif defined(__linux__)
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #endif
 
 namespace
 {
+	constexpr std::chrono::milliseconds keepAliveTimeout(5000);
+
 	void placeholderLogger(const std::string_view&)
 	{}
+
+	std::vector<unsigned> getNumaNodeCpus(unsigned node)
+	{
+		std::vector<unsigned> result;
+
+		#ifdef _WIN32
+		GROUP_AFFINITY affinity;
+
+		if (node <= MAXUSHORT && GetNumaNodeProcessorMaskEx(static_cast<USHORT>(node), &affinity))
+			for (unsigned i = 0; i < 64; ++i)
+				if (affinity.Mask & (KAFFINITY(1) << i))
+					result.push_back(affinity.Group * 64u + i);
+		#elif defined(__linux__)
+		std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist"); //"0-3,8-11"
+		unsigned first, last;
+		char separator;
+
+		while (cpuList >> first)
+		{
+			last = first;
+			if (cpuList.peek() == '-')
+				cpuList >> separator >> last;
+			for (unsigned cpu = first; cpu <= last; ++cpu)
+				result.push_back(cpu);
+			if (cpuList.peek() == ',')
+				cpuList >> separator;
+		}
+		#endif
+
+		return result;
+	}
+
+	#ifdef __linux__
+	sockaddr_un getLocalAddress(std::string_view path)
+	{
+		sockaddr_un address = {};
+
+		if (path.empty() || path.size() >= sizeof(address.sun_path))
+			throw std::invalid_argument("Invalid Unix domain socket path");
+
+		address.sun_family = AF_UNIX;
+		path.copy(address.sun_path, path.size());
+
+		return address;
+	}
+	#endif
+
+	void sendAll(Socket &socket, std::string_view bytes)
+	{
+		std::int64_t bytesSent = 0;
+
+		while (bytesSent < static_cast<decltype(bytesSent)>(bytes.size()))
+			bytesSent += socket.send(bytes.data() + bytesSent, bytes.size() - bytesSent, 0);
+	}
+
+	//-1 on failure, like the WSAPoll and poll it wraps
+	int pollDescriptors(PollFileDescriptor *descriptors, std::size_t count, int timeout) noexcept
+	{
+		#ifdef _WIN32
+		return WSAPoll(descriptors, static_cast<ULONG>(count), timeout);
+		#elif defined(__linux__)
+		return poll(descriptors, static_cast<nfds_t>(count), timeout);
+		#endif
+	}
+
+	int getPollError() noexcept
+	{
+		#ifdef _WIN32
+		return WSAGetLastError();
+		#elif defined(__linux__)
+		return errno;
+		#endif
+	}
+
+	//a send or receive that ran out of the socket's SO_RCVTIMEO/SO_SNDTIMEO
+	bool isTimeout(int errorCode) noexcept
+	{
+		#ifdef _WIN32
+		return errorCode == WSAETIMEDOUT;
+		#elif defined(__linux__)
+		return errorCode == EAGAIN || errorCode == EWOULDBLOCK;
+		#endif
+	}
+
+	//keeps the connection open if the client asked to, unless the response already closes it, as every response does while draining
+	void echoConnectionHeader(Http::Request &request, Http::Response &response)
+	{
+		auto requested = request.getField(Http::Request::HeaderField::Connection);
+		auto current = response.getField(Http::Response::HeaderField::Connection);
+		auto lowercase = [](std::string text)
+		{
+			std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+			return text;
+		};
+
+		if (requested && !(current && lowercase(std::string(current.value())) == "close"))
+			response.setField(Http::Response::HeaderField::Connection, lowercase(std::string(requested.value())));
+	}
+
+	//the per request head goes out corked, so it leaves in the same segment as the start of the body, which is sent from the shared entry
+	void sendCached(Socket &socket, const ResponseCache::Entry &entry, std::optional<std::string_view> connection, bool headOnly, std::pmr::memory_resource *resource)
+	{
+		std::pmr::string head = ResponseCache::serializeHead(entry, connection, resource);
+
+		if (headOnly || entry.mBody.empty())
+		{
+			sendAll(socket, head);
+			return;
+		}
+
+		socket.setCork(true);
+		try
+		{
+			sendAll(socket, head);
+			sendAll(socket, entry.mBody);
+		}
+		catch (const std::runtime_error&)
+		{
+			try
+			{
+				socket.setCork(false);
+			}
+			catch (const SocketException&)
+			{}
+			throw;
+		}
+		socket.setCork(false);
+	}
+
+	struct IdleConnection
+	{
+		ConnectionPool::Pointer mConnection;
+		std::chrono::steady_clock::time_point mParked;
+		short mEvents = POLLIN; //POLLOUT for a TLS handshake that has to send before it can go on
+	};
+
+	//true if a read wouldn't block, which includes the peer having closed the connection
+	bool isReadable(const Socket &socket) noexcept
+	{
+		PollFileDescriptor descriptor = { socket.get(), POLLIN, 0 };
+
+		return socket.hasBufferedData() || pollDescriptors(&descriptor, 1, 0) > 0;
+	}
+
+	//the connection is closed right after, the client can't be expected to have sent its request yet
+	void sendServiceUnavailable(Socket &socket, std::string_view response) noexcept
+	{
+		try
+		{
+			sendAll(socket, response);
+		}
+		catch (const std::runtime_error&)
+		{}
+	}
+
+}
+
+void Http::sendMethodNotAllowed(Request &request, Response &response, std::uint32_t methods)
+{
+	std::string allow;
+
+	for (unsigned i = 0; i < static_cast<unsigned>(Request::Method::Other); ++i)
+	{
+		if (methods & getMethodBit(static_cast<Request::Method>(i)))
+		{
+			if (!allow.empty())
+				allow += ", ";
+			allow += Request::getMethodText(static_cast<Request::Method>(i));
+		}
+	}
+
+	response.setStatusCode(405);
+	response.setField(Response::HeaderField::Allow, allow);
+	response.setField(Response::HeaderField::ContentLength, "0");
+	response.setField(Response::HeaderField::CacheControl, "no-store");
+	echoConnectionHeader(request, response);
+	response.send();
 }
 
 class Http::Server::Impl
 {
 public:
-	std::map<std::string, std::function<HandlerCallback>> mHandlers;
+	Router mRouter;
+	RouteTableCallback *mRouteTable = nullptr;
+	std::function<MiddlewareCallback> mMiddleware;
 	std::jthread mServerThread;
 	
 	std::function<LoggerCallback> mEndpointLogger = placeholderLogger;
 	std::function<LoggerCallback> mErrorLogger = placeholderLogger;
 	std::shared_ptr<Socket> mSocket, mSocketSecure;
+	std::string mCertificateStore, mCertificateName;
 	const int mQueueLength;
 	std::uint16_t mPort, mPortSecure;
+	WritePolicy mWritePolicy = WritePolicy::Interactive;
+	WorkerConfiguration mWorkerConfiguration;
+	AdmissionConfiguration mAdmissionConfiguration;
+	AdmissionControl mAdmissionControl;
+	std::string mServiceUnavailable; //serialized once per start, shedding must stay cheaper than serving
+	std::vector<std::pair<std::string, ExecutorConfiguration>> mExecutorConfigurations; //executor i + 1 of Router::Route::mExecutor
+	MemoryConfiguration mMemoryConfiguration;
+	TLSConfiguration mTLSConfiguration;
+	std::shared_ptr<const TLSContext> mTLSContext; //created on start, every accepted TLS connection handshakes with it and resumes from its sessions
+	BufferPool mBuffers; //before the connection pool, connection arenas give their buffers back to it
+	ConnectionPool mConnectionPool; //before the executors, connections must go back to it before it's destroyed
+	std::vector<std::unique_ptr<ThreadPool>> mExecutors; //created on start, connections are accepted into the first one
+	mutable std::atomic<std::size_t> mConnections = 0; //accepted and not closed yet
+	std::atomic<bool> mDraining = false; //set once the server stops accepting, responses close their connections from then on
+	std::chrono::milliseconds mIdleDeadline = std::chrono::milliseconds(0);
+	mutable Wakeup mWakeup; //interrupts the server thread's poll
+	mutable std::mutex mIdleMutex;
+	mutable std::vector<IdleConnection> mParked; //idle connections on their way to the server thread, which polls them for their next request or handshake message
+	mutable bool mIdleClosed = false; //by a drain, connections that become idle afterwards are closed right away
+	std::atomic<std::size_t> mIdleConnections = 0; //polled by the server thread
 
 	void serverProcedure(std::promise<void>);
-	void handleRequest(std::shared_ptr<Socket>) const;
+	void handleRequest(ConnectionPool::Pointer) const;
+	//serves requests until the connection closes or one of them has to run on another executor. executor is the one running this,
+	//pendingRequest is allocated from the connection's arena.
+	void serveConnection(ConnectionPool::Pointer connection, ThreadPool *executor, std::optional<Request> pendingRequest, const Router::Route *pendingRoute) const;
+	void connectionClosed() const noexcept;
+	//hands a connection that's waiting for its next request to the server thread, so it holds neither a worker nor request buffers.
+	//events are the ones it waits for.
+	void park(ConnectionPool::Pointer connection, short events = POLLIN) const;
+	//the figure checked against the memory budget
+	std::size_t getUsedMemory() const noexcept;
+	bool overBudget() const noexcept;
+	void drain(std::chrono::milliseconds idleDeadline);
+	//false if no route matches the request. route is the router's match, with its captures already given to the request.
+	//resource is the connection's arena
+	bool dispatch(Request &request, Response &response, std::string_view &endpoint, const Router::Route *route, Socket &clientSocket, std::pmr::memory_resource *resource) const;
+	void serveCached(ResponseCache &cache, const Router::Handler &handler, Request &request, Response &response, Socket &clientSocket, std::pmr::memory_resource *resource) const;
 
 	Impl(std::uint16_t, std::uint16_t, int, std::string_view, std::string_view);
+	Impl(const Listeners&, int, std::string_view, std::string_view);
 	~Impl();
 };
 
@@ -48,7 +285,13 @@ void Http::Server::Impl::serverProcedure(std::promise<void> promise)
 		if (mSocket)
 			mSocket->listen(mQueueLength);
 		if (mSocketSecure)
+		{
+			TLSSessionConfiguration sessions = { mTLSConfiguration.mSessionCacheSize, mTLSConfiguration.mSessionLifetime, mTLSConfiguration.mTicketKeyRotation, mTLSConfiguration.mSessionTickets };
+
+			//credentials that can't be loaded fail start instead of every handshake
+			mTLSContext = std::make_shared<TLSContext>(mCertificateStore, mCertificateName, TLSSocket::Role::SERVER, sessions);
 			mSocketSecure->listen(mQueueLength);
+		}
 	}
 	catch (const std::runtime_error&)
 	{
@@ -56,138 +299,453 @@ void Http::Server::Impl::serverProcedure(std::promise<void> promise)
 		return;
 	}
 
+	std::vector<unsigned> cpus = mWorkerConfiguration.mCpus;
+
+	if (cpus.empty() && mWorkerConfiguration.mNumaNode)
+		cpus = getNumaNodeCpus(mWorkerConfiguration.mNumaNode.value());
+
+	mAdmissionControl.setParameters(mAdmissionConfiguration.mTargetQueueDelay, mAdmissionConfiguration.mInterval);
+	mBuffers.setHugePages(mMemoryConfiguration.mHugePages);
+	mServiceUnavailable = "HTTP/1.1 503 Service Unavailable\r\nRetry-After: " + std::to_string(mAdmissionConfiguration.mRetryAfter.count()) + "\r\nContent-Length: 0\r\nCache-Control: no-store\r\nConnection: close\r\n\r\n";
+
 	promise.set_value();
-	ThreadPool pool(static_cast<size_t>(std::thread::hardware_concurrency()) * 2ull);
+	mExecutors.clear();
+	mExecutors.push_back(std::make_unique<ThreadPool>(mWorkerConfiguration.mWorkerCount ? mWorkerConfiguration.mWorkerCount : static_cast<size_t>(std::thread::hardware_concurrency()) * 2ull, cpus));
+	for (auto &executor : mExecutorConfigurations)
+		mExecutors.push_back(std::make_unique<ThreadPool>(std::max<std::size_t>(executor.second.mWorkerCount, 1), executor.second.mCpus));
 	std::vector<PollFileDescriptor> descriptorList;
 	std::vector<std::pair<std::shared_ptr<Socket>, decltype(descriptorList)::size_type>> socketList;
+	std::vector<IdleConnection> idleList; //polled at descriptorList[firstIdle + i]
+	std::optional<std::chrono::steady_clock::time_point> idleDeadline; //set once draining starts
 	std::stop_token stopToken = mServerThread.get_stop_token();
 
+	descriptorList.push_back({ mWakeup.get(), POLLIN, 0 });
+
 	if (mSocket)
 	{
-		descriptorList.push_back({ mSocket->get(), POLLIN });
+		descriptorList.push_back({ mSocket->get(), POLLIN, 0 });
 		socketList.emplace_back(mSocket, descriptorList.size() - 1);
 	}
 
 	if (mSocketSecure)
 	{
-		descriptorList.push_back({ mSocketSecure->get(), POLLIN });
+		descriptorList.push_back({ mSocketSecure->get(), POLLIN, 0 });
 		socketList.emplace_back(mSocketSecure, descriptorList.size() - 1);
 	}
 
-	while (!stopToken.stop_requested())
+	std::size_t firstIdle = descriptorList.size();
+	auto takeIdle = [&](std::size_t i)
 	{
-		if (auto returnValue = WSAPoll(descriptorList.data(), static_cast<ULONG>(descriptorList.size()), 1000); returnValue != SOCKET_ERROR)
+		ConnectionPool::Pointer connection = std::move(idleList[i].mConnection);
+
+		idleList[i] = std::move(idleList.back());
+		idleList.pop_back();
+		descriptorList[firstIdle + i] = descriptorList.back();
+		descriptorList.pop_back();
+
+		return connection;
+	};
+
+	while (true)
+	{
+		if (!idleDeadline && stopToken.stop_requested())
 		{
-			for (auto &entry : socketList)
-				if (descriptorList[entry.second].revents & POLLIN)
-					pool.addTask(std::bind(&Impl::handleRequest, this, std::shared_ptr<Socket>(entry.first->accept())));
-					//std::thread(&Impl::handleRequest, this, std::shared_ptr<Socket>(entry.first->accept())).detach();
+			//idle connections get until the drain's deadline to send one last request
+			idleDeadline = std::chrono::steady_clock::now() + mIdleDeadline;
+			mDraining.store(true);
+			descriptorList.erase(descriptorList.begin() + 1, descriptorList.begin() + firstIdle);
+			socketList.clear();
+			firstIdle = 1;
 		}
-		else
+
+		if (idleDeadline && (!mConnections.load() || std::chrono::steady_clock::now() >= *idleDeadline))
+			break;
+
+		auto returnValue = pollDescriptors(descriptorList.data(), descriptorList.size(), idleDeadline ? 10 : 1000);
+		auto now = std::chrono::steady_clock::now();
+
+		if (returnValue == -1)
 		{
-			mErrorLogger("poll error code " + std::to_string(returnValue) + ", server stopped");
+			int error = getPollError();
+
+			#ifdef __linux__
+			if (error == EINTR)
+				continue;
+			#endif
+			mErrorLogger("poll error code " + std::to_string(error) + ", server stopped");
 			break;
 		}
+
+		if (descriptorList.front().revents & POLLIN)
+		{
+			std::lock_guard<std::mutex> lck(mIdleMutex);
+
+			mWakeup.clear();
+			for (auto &idle : mParked)
+			{
+				descriptorList.push_back({ idle.mConnection->getSocket().get(), idle.mEvents, 0 });
+				idleList.push_back(std::move(idle));
+			}
+			mParked.clear();
+		}
+
+		for (auto &entry : socketList)
+			if (descriptorList[entry.second].revents & POLLIN)
+			{
+				ConnectionPool::Pointer connection = mConnectionPool.acquire();
+
+				if (entry.first == mSocketSecure)
+					connection->open(entry.first->acceptDescriptor(), mTLSContext);
+				else
+					connection->open(entry.first->acceptDescriptor());
+
+				std::optional<unsigned> cpu = mWorkerConfiguration.mFollowIncomingCpu ? connection->getSocket().getIncomingCpu() : std::nullopt;
+				auto accepted = std::chrono::steady_clock::now();
+
+				if ((mAdmissionConfiguration.mMaxPendingConnections && mConnections.load(std::memory_order_relaxed) >= mAdmissionConfiguration.mMaxPendingConnections) || overBudget())
+				{
+					//TLS sockets would have to finish their handshake on this thread to answer, they're just closed
+					if (entry.first != mSocketSecure)
+						sendServiceUnavailable(connection->getSocket(), mServiceUnavailable);
+					continue;
+				}
+
+				mConnections.fetch_add(1, std::memory_order_relaxed);
+				mExecutors.front()->addTask([this, connection = std::move(connection), accepted]() mutable
+				{
+					if (mAdmissionControl.shouldShed(std::chrono::steady_clock::now() - accepted))
+					{
+						mEndpointLogger("Shed socket " + std::to_string(connection->getSocket().get()) + ", the connection queue is overloaded");
+						sendServiceUnavailable(connection->getSocket(), mServiceUnavailable);
+						connection.reset();
+						connectionClosed();
+					}
+					else
+						handleRequest(std::move(connection));
+				}, cpu);
+				//std::thread(&Impl::handleRequest, this, std::shared_ptr<Socket>(entry.first->accept())).detach();
+			}
+
+		//backwards, taking an entry moves the last one into its place
+		for (std::size_t i = idleList.size(); i--;)
+		{
+			auto events = descriptorList[firstIdle + i].revents;
+
+			if (events & (POLLERR | POLLHUP | POLLNVAL))
+			{
+				mEndpointLogger("Socket " + std::to_string(descriptorList[firstIdle + i].fd) + " closed while idle");
+				takeIdle(i).reset();
+				connectionClosed();
+			}
+			else if (events & (POLLIN | POLLOUT))
+			{
+				ConnectionPool::Pointer connection = takeIdle(i);
+				std::optional<unsigned> cpu = mWorkerConfiguration.mFollowIncomingCpu ? connection->getSocket().getIncomingCpu() : std::nullopt;
+
+				connection->setIdle(false);
+				mExecutors.front()->addTask([this, connection = std::move(connection)]() mutable
+				{
+					serveConnection(std::move(connection), mExecutors.front().get(), std::nullopt, nullptr);
+				}, cpu);
+			}
+			else if (TLSSocket *secureSocket = idleList[i].mConnection->getSecureSocket(); secureSocket && !secureSocket->isEstablished())
+			{
+				//the whole handshake gets one timeout, a client can't keep it going by sending a byte at a time
+				if (now - idleList[i].mConnection->getOpenedTime() >= keepAliveTimeout)
+				{
+					mEndpointLogger("TLS handshake timed out on socket " + std::to_string(descriptorList[firstIdle + i].fd));
+					takeIdle(i).reset();
+					connectionClosed();
+				}
+			}
+			else if (now - idleList[i].mParked >= keepAliveTimeout)
+			{
+				mEndpointLogger("keep-alive expired on socket " + std::to_string(descriptorList[firstIdle + i].fd));
+				takeIdle(i).reset();
+				connectionClosed();
+			}
+		}
+
+		if (!idleList.empty() && overBudget())
+		{
+			//the connections idle the longest are the least likely to send another request
+			std::size_t closed = 0;
+
+			std::sort(idleList.begin(), idleList.end(), [](const IdleConnection &a, const IdleConnection &b) { return a.mParked < b.mParked; });
+			for (; closed < idleList.size() && overBudget(); ++closed)
+			{
+				mEndpointLogger("Closed idle socket " + std::to_string(idleList[closed].mConnection->getSocket().get()) + ", the memory budget is exhausted");
+				idleList[closed].mConnection.reset();
+				connectionClosed();
+			}
+
+			idleList.erase(idleList.begin(), idleList.begin() + closed);
+			descriptorList.resize(firstIdle);
+			for (auto &idle : idleList)
+				descriptorList.push_back({ idle.mConnection->getSocket().get(), idle.mEvents, 0 });
+		}
+
+		mIdleConnections.store(idleList.size(), std::memory_order_relaxed);
 	}
 
-	pool.waitForTasks();
+	mDraining.store(true);
+
+	{
+		std::lock_guard<std::mutex> lck(mIdleMutex);
+
+		mIdleClosed = true;
+		for (auto &idle : mParked)
+			idleList.push_back(std::move(idle));
+		mParked.clear();
+	}
+
+	for (auto &idle : idleList)
+	{
+		mEndpointLogger("Closed idle socket " + std::to_string(idle.mConnection->getSocket().get()) + " while draining");
+		idle.mConnection.reset();
+		connectionClosed();
+	}
+	idleList.clear();
+	mIdleConnections.store(0, std::memory_order_relaxed);
+
+	//connections hop between executors, waiting for each pool to drain in turn could miss one in flight
+	for (std::size_t connections = mConnections.load(); connections; connections = mConnections.load())
+		mConnections.wait(connections);
+	mExecutors.clear();
 }
 
 Http::Server::Impl::~Impl()
 {
+	drain(std::chrono::milliseconds(0));
+}
+
+void Http::Server::Impl::drain(std::chrono::milliseconds idleDeadline)
+{
+	mIdleDeadline = idleDeadline; //read by the server thread after it sees the stop request
+	mDraining.store(true);
 	mServerThread.get_stop_source().request_stop();
+	mWakeup.notify();
 	if (mServerThread.joinable())
 		mServerThread.join();
-	if (mSocket)
-		mSocket->close();
-	if (mSocketSecure)
-		mSocketSecure->close();
+
+	//the connections left in the backlog are reset, unless the listeners were handed off and the other process accepts them
+	mSocket.reset();
+	mSocketSecure.reset();
 }
 
-void Http::Server::Impl::handleRequest(std::shared_ptr<Socket> clientSocket) const
+void Http::Server::Impl::park(ConnectionPool::Pointer connection, short events) const
 {
+	connection->getArena().reset();
+	if (TLSSocket *secureSocket = connection->getSecureSocket())
+		secureSocket->releaseBuffers();
+	connection->updateSocketBytes();
+	connection->setIdle(true);
+
+	{
+		std::lock_guard<std::mutex> lck(mIdleMutex);
+
+		if (!mIdleClosed)
+			mParked.push_back({ std::move(connection), std::chrono::steady_clock::now(), events });
+	}
+
+	if (connection)
+	{
+		mEndpointLogger("Closed idle socket " + std::to_string(connection->getSocket().get()) + " while draining");
+		connection.reset();
+		connectionClosed();
+		return;
+	}
+
+	mWakeup.notify();
+}
+
+std::size_t Http::Server::Impl::getUsedMemory() const noexcept
+{
+	return mConnections.load(std::memory_order_relaxed) * sizeof(Connection) + mBuffers.getUsedBytes() + mConnectionPool.getSocketBytes();
+}
+
+bool Http::Server::Impl::overBudget() const noexcept
+{
+	return mMemoryConfiguration.mBudget && getUsedMemory() > mMemoryConfiguration.mBudget;
+}
+
+void Http::Server::Impl::handleRequest(ConnectionPool::Pointer connection) const
+{
+	Socket &clientSocket = connection->getSocket();
+
 	try
 	{
-		DWORD timeout = 5000;
-		mEndpointLogger("Connected socket " + std::to_string(clientSocket->get()));
-		clientSocket->setSocketOption(SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
-		clientSocket->setSocketOption(SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		#ifdef _WIN32
+		DWORD timeout = static_cast<DWORD>(keepAliveTimeout.count());
+		#elif defined(__linux__)
+		auto seconds = std::chrono::duration_cast<std::chrono::seconds>(keepAliveTimeout);
+		timeval timeout = { static_cast<time_t>(seconds.count()), static_cast<suseconds_t>(std::chrono::duration_cast<std::chrono::microseconds>(keepAliveTimeout - seconds).count()) };
+		#endif
+		mEndpointLogger("Connected socket " + std::to_string(clientSocket.get()));
+		clientSocket.setSocketOption(SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		clientSocket.setSocketOption(SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		if (mWritePolicy == WritePolicy::Interactive)
+			clientSocket.setNoDelay(true);
+		if (connection->getSecureSocket())
+			clientSocket.toggleNonBlockingMode(true); //until the handshake is done, see continueHandshake
+	}
+	catch (const SocketException &e)
+	{
+		mErrorLogger(e.what());
+		connection.reset();
+		connectionClosed();
+		return;
+	}
 
-		while (true)
+	serveConnection(std::move(connection), mExecutors.front().get(), std::nullopt, nullptr);
+}
+
+void Http::Server::Impl::serveConnection(ConnectionPool::Pointer connection, ThreadPool *executor, std::optional<Request> pendingRequest, const Router::Route *pendingRoute) const
+{
+	Socket &clientSocket = connection->getSocket();
+	RequestArena &arena = connection->getArena();
+
+	//the handshake goes as far as it can without waiting, then the connection waits on the server thread for the client's next message
+	if (TLSSocket *secureSocket = connection->getSecureSocket(); secureSocket && !secureSocket->isEstablished())
+	{
+		try
 		{
-			try
-			{
-				char c;
-				clientSocket->Socket::receive(&c, 1, MSG_PEEK); //Wait until there's data to read
-			}
-			catch (const SocketException &e)
+			TLSSocket::HandshakeStatus status = secureSocket->continueHandshake();
+
+			if (status != TLSSocket::HandshakeStatus::Complete)
 			{
-				using namespace std::string_literals;
-				if (e.getErrorCode() == WSAETIMEDOUT) //Ok, keep-alive timeout expired
-					mEndpointLogger("keep-alive expired on socket " + std::to_string(clientSocket->get()));
-				else
-					mErrorLogger(e.what());
-				break;
+				park(std::move(connection), status == TLSSocket::HandshakeStatus::WantWrite ? POLLOUT : POLLIN);
+				return;
 			}
-			Request request(clientSocket);
-			decltype(mHandlers)::const_iterator bestMatch = mHandlers.cend();
+			secureSocket->toggleNonBlockingMode(false); //requests are read within the socket's timeouts
+		}
+		catch (const SocketException &e)
+		{
+			mErrorLogger("TLS handshake failed on socket " + std::to_string(clientSocket.get()) + ": " + e.what());
+			connection.reset();
+			connectionClosed();
+			return;
+		}
+	}
 
-			for (decltype(mHandlers)::const_iterator handlerSlot = mHandlers.cbegin(); handlerSlot != mHandlers.cend(); ++handlerSlot)
+	try
+	{
+		while (true)
+		{
+			if (!pendingRequest)
 			{
-				std::string_view requestResource = request.getResourcePath();
-				std::string::size_type lastSlash = requestResource.rfind('/');
+				//the next request usually follows the response right away, connections with nothing to read wait on the server thread
+				if (!isReadable(clientSocket))
+				{
+					park(std::move(connection));
+					return;
+				}
 
-				if (lastSlash != std::string::npos)
+				arena.reset(); //the previous request and its response are gone
+
+				try
 				{
-					std::string::size_type matchPos = requestResource.find(handlerSlot->first);
-					if (!matchPos && !handlerSlot->first.compare(0, lastSlash + 1, requestResource, 0, lastSlash + 1))
-					{ //if it matches at the beginning, and to the last slash
-						if (bestMatch == mHandlers.cend() || handlerSlot->first.size() > bestMatch->first.size())
-							bestMatch = handlerSlot;
-					}
+					pendingRequest.emplace(Request(clientSocket, arena.get()));
+				}
+				catch (const SocketException &e)
+				{
+					if (isTimeout(e.getErrorCode()))
+						mEndpointLogger("Timed out reading a request on socket " + std::to_string(clientSocket.get()));
+					else
+						mErrorLogger(e.what());
+					break;
+				}
+
+				connection->updateSocketBytes(); //reading the request allocated the TLS receive buffers
+				if (overBudget())
+					mWakeup.notify(); //the server thread closes idle connections to make room
+
+				Router::Captures captures(arena.get());
+				pendingRoute = mRouter.find(pendingRequest->getResourcePath(), captures);
+				if (pendingRoute)
+					pendingRequest->setPathParameters(captures);
+
+				//unrouted requests and the route table stay where they are, they're answered right away
+				if (pendingRoute && pendingRoute->mExecutor != Router::Route::inlineExecutor && mExecutors[pendingRoute->mExecutor].get() != executor)
+				{
+					//the task always runs, executors outlive every connection, so the request never outlives the arena it's allocated from
+					mExecutors[pendingRoute->mExecutor]->addTask([this, connection = std::move(connection), request = std::move(*pendingRequest), route = pendingRoute]() mutable
+					{
+						serveConnection(std::move(connection), mExecutors[route->mExecutor].get(), std::move(request), route);
+					});
+					return;
 				}
 			}
 
-			if (bestMatch != mHandlers.cend())
+			Request request(std::move(*pendingRequest));
+			const Router::Route *route = std::exchange(pendingRoute, nullptr);
+			pendingRequest.reset();
+
+			std::string_view endpoint = request.getResourcePath(); //route table paths are exact, so they're the endpoint name too
+
+			try
 			{
-				std::string logMessage("Served request at endpoint \"" + bestMatch->first + '\"');
-				try
+				Response response(clientSocket, arena.get());
+				bool routed = true;
+				auto dispatchRequest = [&](Request &request, Response &response)
 				{
-					Response response(clientSocket);
-					bestMatch->second(request, response);
+					if (mDraining.load(std::memory_order_relaxed)) //after the middleware, so it overrides keep-alive
+						response.setField(Response::HeaderField::Connection, "close");
+					routed = dispatch(request, response, endpoint, route, clientSocket, arena.get());
+				};
 
-					auto requestConnectionHeader = request.getField(Request::HeaderField::Connection), responseConnectionHeader = response.getField(Response::HeaderField::Connection);
+				if (request.getMethodId() == Request::Method::Head)
+					response.suppressBody();
 
-					if (requestConnectionHeader && responseConnectionHeader)
-					{
-						std::string requestConnectionHeaderCopy = requestConnectionHeader.value().data();
-						std::transform(requestConnectionHeaderCopy.begin(), requestConnectionHeaderCopy.end(), requestConnectionHeaderCopy.begin(), tolower); //Edge sends Keep-alive, instead of keep-alive
-
-						if (!(requestConnectionHeaderCopy == "keep-alive" && responseConnectionHeader.value() == requestConnectionHeaderCopy)) //No keep-alive, exit...
-						{
-							mEndpointLogger(logMessage);
-							break;
-						}
-					}
+				if (mMiddleware)
+					mMiddleware(request, response, dispatchRequest);
+				else
+					dispatchRequest(request, response);
 
+				if (!routed)
+					continue;
+
+				std::string logMessage("Served request at endpoint \"");
+				auto requestConnectionHeader = request.getField(Request::HeaderField::Connection), responseConnectionHeader = response.getField(Response::HeaderField::Connection);
+
+				logMessage.append(endpoint);
+				logMessage += '\"';
+
+				if (mDraining.load(std::memory_order_relaxed))
+				{
 					mEndpointLogger(logMessage);
+					break;
 				}
-				catch (const std::exception &e)
+
+				if (requestConnectionHeader && responseConnectionHeader)
 				{
-					Response serverErrorResponse(clientSocket);
-
-					logMessage = "Exception thrown at endpoint ";
-					logMessage.append(bestMatch->first);
-					logMessage.append(": ");
-					logMessage.append(e.what());
-					mErrorLogger(logMessage);
-
-					serverErrorResponse.setStatusCode(500);
-					serverErrorResponse.setField(Response::HeaderField::CacheControl, "no-store");
-					serverErrorResponse.setField(Response::HeaderField::Connection, "close");
-					serverErrorResponse.send();
-					break;
+					std::string requestConnectionHeaderCopy = requestConnectionHeader.value().data();
+					std::transform(requestConnectionHeaderCopy.begin(), requestConnectionHeaderCopy.end(), requestConnectionHeaderCopy.begin(), tolower); //Edge sends Keep-alive, instead of keep-alive
+
+					if (!(requestConnectionHeaderCopy == "keep-alive" && responseConnectionHeader.value() == requestConnectionHeaderCopy)) //No keep-alive, exit...
+					{
+						mEndpointLogger(logMessage);
+						break;
+					}
 				}
+
+				mEndpointLogger(logMessage);
+			}
+			catch (const std::exception &e)
+			{
+				Response serverErrorResponse(clientSocket, arena.get());
+				std::string logMessage("Exception thrown at endpoint ");
+
+				logMessage.append(endpoint);
+				logMessage.append(": ");
+				logMessage.append(e.what());
+				mErrorLogger(logMessage);
+
+				serverErrorResponse.setStatusCode(500);
+				serverErrorResponse.setField(Response::HeaderField::CacheControl, "no-store");
+				serverErrorResponse.setField(Response::HeaderField::Connection, "close");
+				serverErrorResponse.send();
+				break;
 			}
 		}
 	}
@@ -195,15 +753,113 @@ void Http::Server::Impl::handleRequest(std::shared_ptr<Socket> clientSocket) con
 	{
 		mErrorLogger(e.what());
 	}
+
+	connection.reset();
+	connectionClosed();
+}
+
+void Http::Server::Impl::connectionClosed() const noexcept
+{
+	if (mConnections.fetch_sub(1, std::memory_order_acq_rel) == 1)
+		mConnections.notify_all();
+}
+
+bool Http::Server::Impl::dispatch(Request &request, Response &response, std::string_view &endpoint, const Router::Route *route, Socket &clientSocket, std::pmr::memory_resource *resource) const
+{
+	Request::Method method = request.getMethodId();
+
+	if (mRouteTable && mRouteTable(request, response))
+		return true;
+
+	if (!route)
+		return false;
+
+	endpoint = route->mPattern;
+
+	const Router::Handler *handler = route->getHandler(method);
+
+	if (!handler)
+		sendMethodNotAllowed(request, response, route->mAllowedMethods);
+	else if (route->mCache && (method == Request::Method::Get || method == Request::Method::Head))
+		serveCached(*route->mCache, *handler, request, response, clientSocket, resource);
+	else
+		(*handler)(request, response);
+
+	return true;
+}
+
+void Http::Server::Impl::serveCached(ResponseCache &cache, const Router::Handler &handler, Request &request, Response &response, Socket &clientSocket, std::pmr::memory_resource *resource) const
+{
+	bool head = request.getMethodId() == Request::Method::Head;
+	std::string key = cache.makeKey(request);
+	ResponseCache::Lookup lookup = cache.lookup(key, !head);
+
+	if (!lookup.mEntry && !lookup.mFill) //nothing to serve and someone else is filling it, or it's a HEAD request
+	{
+		handler(request, response);
+		return;
+	}
+
+	if (!lookup.mEntry) //miss, run the handler for everyone waiting on this key
+	{
+		std::string captured;
+		std::shared_ptr<const ResponseCache::Entry> entry;
+
+		response.setCaptureBuffer(&captured);
+		try
+		{
+			handler(request, response);
+		}
+		catch (...)
+		{
+			cache.store(key, nullptr);
+			throw;
+		}
+		response.setCaptureBuffer(nullptr);
+
+		entry = ResponseCache::makeEntry(std::move(captured));
+		cache.store(key, response.getField(Response::HeaderField::SetCookie) ? nullptr : entry);
+		if (!entry)
+			throw ResponseException("Handler didn't send a complete response");
+
+		sendCached(clientSocket, *entry, response.getField(Response::HeaderField::Connection), false, resource);
+		return;
+	}
+
+	echoConnectionHeader(request, response);
+	sendCached(clientSocket, *lookup.mEntry, response.getField(Response::HeaderField::Connection), head, resource);
+
+	if (lookup.mFill) //stale, refresh it now that the client has its response
+	{
+		std::string captured;
+
+		try
+		{
+			Response refresh(clientSocket);
+
+			refresh.setCaptureBuffer(&captured);
+			handler(request, refresh);
+			refresh.setCaptureBuffer(nullptr);
+			cache.store(key, refresh.getField(Response::HeaderField::SetCookie) ? nullptr : ResponseCache::makeEntry(std::move(captured)));
+		}
+		catch (const std::exception &e)
+		{
+			cache.store(key, nullptr);
+			mErrorLogger(std::string("Exception thrown while refreshing a cached response: ") + e.what());
+		}
+	}
 }
 
 Http::Server::Impl::Impl(std::uint16_t port, std::uint16_t portSecure, int connectionQueueLength, std::string_view certificateStore, std::string_view certificateName)
 	:mSocket(port ? new Socket(AF_INET, SOCK_STREAM, 0) : nullptr)
 	,mSocketSecure(portSecure ? new TLSSocket(AF_INET, certificateStore, certificateName) : nullptr)
+	,mCertificateStore(certificateStore)
+	,mCertificateName(certificateName)
+	,mQueueLength(connectionQueueLength)
 	,mPort(port)
 	,mPortSecure(portSecure)
-	,mEndpointLogger(placeholderLogger)
-	,mQueueLength(connectionQueueLength)
+	,mAdmissionControl(mAdmissionConfiguration.mTargetQueueDelay, mAdmissionConfiguration.mInterval)
+	,mConnectionPool(&mBuffers)
 {
 	if (!port && !portSecure)
 		throw std::invalid_argument("At least one of the ports must be different than zero");
@@ -215,6 +871,21 @@ Http::Server::Impl::Impl(std::uint16_t port, std::uint16_t portSecure, int conne
 		mSocketSecure->bind("0.0.0.0", mPortSecure, true);
 }
 
+Http::Server::Impl::Impl(const Listeners &listeners, int connectionQueueLength, std::string_view certificateStore, std::string_view certificateName)
+	:mSocket(listeners.mSocket != -1 ? new Socket(static_cast<DescriptorType>(listeners.mSocket)) : nullptr)
+	,mSocketSecure(listeners.mSocketSecure != -1 ? new TLSSocket(Socket(static_cast<DescriptorType>(listeners.mSocketSecure)), certificateStore, certificateName) : nullptr)
+	,mCertificateStore(certificateStore)
+	,mCertificateName(certificateName)
+	,mQueueLength(connectionQueueLength)
+	,mPort(0)
+	,mPortSecure(0)
+	,mAdmissionControl(mAdmissionConfiguration.mTargetQueueDelay, mAdmissionConfiguration.mInterval)
+	,mConnectionPool(&mBuffers)
+{
+	if (!mSocket && !mSocketSecure)
+		throw std::invalid_argument("At least one of the listeners must be valid");
+}
+
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -226,6 +897,10 @@ Http::Server::Server(std::uint16_t port, std::uint16_t portSecure, int connectio
 	:mThis(new Impl(port, portSecure, connectionQueueLength, certificateStore, certificateName))
 {}
 
+Http::Server::Server(const Listeners &listeners, int connectionQueueLength, std::string_view certificateStore, std::string_view certificateName)
+	:mThis(new Impl(listeners, connectionQueueLength, certificateStore, certificateName))
+{}
+
 Http::Server::~Server() noexcept
 {
 	delete mThis;
@@ -253,6 +928,130 @@ void Http::Server::start()
 	future.get(); //will throw the exception thrown in serverProcedure if something went wrong during startup
 }
 
+void Http::Server::drain(std::chrono::milliseconds idleDeadline)
+{
+	mThis->drain(idleDeadline);
+}
+
+void Http::Server::handOffListeners(const std::string_view &path)
+{
+	#ifdef _WIN32
+	throw std::runtime_error("Listener handoff is only supported on Linux");
+	#elif defined(__linux__)
+	Socket channel(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = getLocalAddress(path);
+	int descriptors[2];
+	char present = 0; //which listeners follow, the plain one first
+	std::size_t count = 0;
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(descriptors))] = {};
+	iovec data = { &present, 1 };
+	msghdr message = {};
+
+	if (mThis->mSocket)
+	{
+		descriptors[count++] = mThis->mSocket->get();
+		present |= 1;
+	}
+	if (mThis->mSocketSecure)
+	{
+		descriptors[count++] = mThis->mSocketSecure->get();
+		present |= 2;
+	}
+	if (!count)
+		throw std::runtime_error("The server has no listeners to hand off");
+
+	message.msg_iov = &data;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+
+	cmsghdr *header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(count * sizeof(int));
+	std::memcpy(CMSG_DATA(header), descriptors, count * sizeof(int));
+
+	if (::connect(channel.get(), reinterpret_cast<sockaddr*>(&address), sizeof(address)) || sendmsg(channel.get(), &message, MSG_NOSIGNAL) != 1)
+		throw SocketException(errno);
+	#endif
+}
+
+Http::Server::Listeners Http::Server::getActivationListeners()
+{
+	Listeners result;
+
+	#ifdef __linux__
+	constexpr int firstDescriptor = 3; //SD_LISTEN_FDS_START
+	const char *pid = std::getenv("LISTEN_PID"), *count = std::getenv("LISTEN_FDS");
+
+	if (pid && count && std::strtol(pid, nullptr, 10) == getpid())
+	{
+		long descriptorCount = std::strtol(count, nullptr, 10);
+
+		for (long i = 0; i < descriptorCount; ++i)
+			fcntl(firstDescriptor + static_cast<int>(i), F_SETFD, FD_CLOEXEC);
+		if (descriptorCount > 0)
+			result.mSocket = firstDescriptor;
+		if (descriptorCount > 1)
+			result.mSocketSecure = firstDescriptor + 1;
+
+		//they're ours now, processes we start mustn't think they're meant for them
+		unsetenv("LISTEN_PID");
+		unsetenv("LISTEN_FDS");
+		unsetenv("LISTEN_FDNAMES");
+	}
+	#endif
+
+	return result;
+}
+
+Http::Server::Listeners Http::Server::receiveListeners(const std::string_view &path)
+{
+	#ifdef _WIN32
+	throw std::runtime_error("Listener handoff is only supported on Linux");
+	#elif defined(__linux__)
+	Listeners result;
+	Socket listener(AF_UNIX, SOCK_STREAM, 0);
+	sockaddr_un address = getLocalAddress(path);
+	std::string pathCopy(path);
+	int descriptors[2];
+	char present = 0;
+	alignas(cmsghdr) char control[CMSG_SPACE(sizeof(descriptors))] = {};
+	iovec data = { &present, 1 };
+	msghdr message = {};
+
+	unlink(pathCopy.c_str()); //left behind by a previous restart
+	if (::bind(listener.get(), reinterpret_cast<sockaddr*>(&address), sizeof(address)))
+		throw SocketException(errno);
+	listener.listen(1);
+
+	std::unique_ptr<Socket> channel(listener.accept());
+	message.msg_iov = &data;
+	message.msg_iovlen = 1;
+	message.msg_control = control;
+	message.msg_controllen = sizeof(control);
+
+	auto received = recvmsg(channel->get(), &message, MSG_CMSG_CLOEXEC);
+	unlink(pathCopy.c_str());
+	if (received != 1)
+		throw SocketException(received < 0 ? errno : EPROTO);
+
+	cmsghdr *header = CMSG_FIRSTHDR(&message);
+	std::size_t count = header && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS ? (header->cmsg_len - CMSG_LEN(0)) / sizeof(int) : 0;
+	std::size_t next = 0;
+
+	count = std::min(count, std::size(descriptors));
+	if (count)
+		std::memcpy(descriptors, CMSG_DATA(header), count * sizeof(int));
+	if ((present & 1) && next < count)
+		result.mSocket = descriptors[next++];
+	if ((present & 2) && next < count)
+		result.mSocketSecure = descriptors[next++];
+
+	return result;
+	#endif
+}
+
 void Http::Server::setEndpointLogger(const std::function<LoggerCallback> &callback) noexcept
 {
 	mThis->mEndpointLogger = callback ? callback : placeholderLogger;
@@ -263,7 +1062,97 @@ void Http::Server::setErrorLogger(const std::function<LoggerCallback> &callback)
 	mThis->mErrorLogger = callback ? callback : placeholderLogger;
 }
 
-void Http::Server::setResourceCallback(const std::string_view &path, const std::function<HandlerCallback> &callback)
+void Http::Server::setResourceCallback(const std::string_view &path, const std::function<HandlerCallback> &callback, RouteType type)
+{
+	mThis->mRouter.insert(path, type, std::nullopt, callback);
+}
+
+void Http::Server::setResourceCallback(const std::string_view &path, Request::Method method, const std::function<HandlerCallback> &callback, RouteType type)
+{
+	mThis->mRouter.insert(path, type, method, callback);
+}
+
+void Http::Server::setResponseCache(const std::string_view &path, const ResponseCachePolicy &policy, RouteType type)
+{
+	mThis->mRouter.setCache(path, type, std::make_shared<ResponseCache>(policy));
+}
+
+void Http::Server::setRouteTable(RouteTableCallback *table) noexcept
+{
+	mThis->mRouteTable = table;
+}
+
+void Http::Server::setMiddleware(const std::function<MiddlewareCallback> &middleware)
+{
+	mThis->mMiddleware = middleware;
+}
+
+void Http::Server::setWritePolicy(WritePolicy policy) noexcept
+{
+	mThis->mWritePolicy = policy;
+}
+
+void Http::Server::setWorkerConfiguration(const WorkerConfiguration &configuration)
+{
+	mThis->mWorkerConfiguration = configuration;
+}
+
+void Http::Server::setAdmissionConfiguration(const AdmissionConfiguration &configuration)
 {
-	mThis->mHandlers[path.data()] = callback;
+	mThis->mAdmissionConfiguration = configuration;
+}
+
+void Http::Server::setMemoryConfiguration(const MemoryConfiguration &configuration)
+{
+	mThis->mMemoryConfiguration = configuration;
+}
+
+void Http::Server::setTLSConfiguration(const TLSConfiguration &configuration)
+{
+	mThis->mTLSConfiguration = configuration;
+}
+
+Http::Server::MemoryUsage Http::Server::getMemoryUsage() const
+{
+	MemoryUsage usage;
+
+	usage.mBytes = mThis->getUsedMemory();
+	usage.mBufferBytes = mThis->mBuffers.getUsedBytes();
+	usage.mSocketBufferBytes = mThis->mConnectionPool.getSocketBytes();
+	usage.mReservedBytes = mThis->mBuffers.getReservedBytes();
+	usage.mIdleConnections = mThis->mIdleConnections.load(std::memory_order_relaxed);
+	mThis->mConnectionPool.forEach([&usage](const Connection &connection)
+	{
+		if (std::intptr_t socket = connection.getDescriptor(); socket != -1)
+			usage.mConnections.push_back({ socket, connection.getMemoryUsage(), connection.getPeakMemoryUsage(), connection.isIdle() });
+	});
+
+	return usage;
+}
+
+void Http::Server::setExecutor(const std::string_view &name, const ExecutorConfiguration &configuration)
+{
+	auto &configurations = mThis->mExecutorConfigurations;
+	auto executor = std::find_if(configurations.begin(), configurations.end(), [name](const auto &executor) { return executor.first == name; });
+
+	if (name == inlineExecutor)
+		throw std::invalid_argument("The inline executor can't be configured");
+
+	if (executor == configurations.end())
+		configurations.emplace_back(name, configuration);
+	else
+		executor->second = configuration;
+}
+
+void Http::Server::setRouteExecutor(const std::string_view &path, const std::string_view &executor, RouteType type)
+{
+	auto &configurations = mThis->mExecutorConfigurations;
+	auto configuration = std::find_if(configurations.begin(), configurations.end(), [executor](const auto &configuration) { return configuration.first == executor; });
+
+	if (executor == inlineExecutor)
+		mThis->mRouter.setExecutor(path, type, Router::Route::inlineExecutor);
+	else if (configuration != configurations.end())
+		mThis->mRouter.setExecutor(path, type, configuration - configurations.begin() + 1);
+	else
+		throw std::invalid_argument("No executor named " + std::string(executor));
 }
\ No newline at end of file
@@ -0,0 +1,470 @@
+#include <array>
+#include <string>
+#include <algorithm>
+#include <charconv>
+#include <cctype>
+#include <system_error>
+#include <optional>
+#include <vector>
+#include <span>
+#include "HttpStaticFileHandler.h"
+#include "HttpRequest.h"
+#include "HttpResponse.h"
+#include "HttpRouteTable.h"
+#include "File.h"
+#include "FileMetadata.h"
+#include "FileCache.h"
+#include "FileDescriptorCache.h"
+
+namespace
+{
+	using Http::Request;
+	using Http::Response;
+
+	std::string_view trim(std::string_view value)
+	{
+		value.remove_prefix(std::min(value.find_first_not_of(" \t"), value.size()));
+		value.remove_suffix(value.size() - std::min(value.find_last_not_of(" \t") + 1, value.size()));
+
+		return value;
+	}
+
+	//weak comparison, as required for If-None-Match
+	bool matchesETag(std::string_view header, std::string_view etag)
+	{
+		while (!header.empty())
+		{
+			auto comma = header.find(',');
+			std::string_view candidate = trim(header.substr(0, comma));
+
+			if (candidate.starts_with("W/"))
+				candidate.remove_prefix(2);
+			if (candidate == "*" || candidate == etag)
+				return true;
+
+			header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+		}
+
+		return false;
+	}
+
+	struct ByteRange
+	{
+		std::uint64_t mFirst, mLast; //inclusive, as in Content-Range
+	};
+
+	//An empty optional means the header has to be ignored and the whole representation sent, an empty vector means none of the ranges can be satisfied.
+	//Overlapping ranges are merged, so a client can't make us send the same bytes over and over.
+	std::optional<std::vector<ByteRange>> parseRange(std::string_view header, std::uint64_t size)
+	{
+		constexpr std::size_t maxRanges = 16;
+		std::vector<ByteRange> result;
+		auto number = [](std::string_view text, std::uint64_t &value) {
+			return !text.empty() && std::from_chars(text.data(), text.data() + text.size(), value).ptr == text.data() + text.size();
+		};
+
+		if (!header.starts_with("bytes="))
+			return std::optional<std::vector<ByteRange>>();
+
+		for (header.remove_prefix(6); !header.empty();)
+		{
+			auto comma = header.find(',');
+			std::string_view specifier = trim(header.substr(0, comma));
+			std::uint64_t first, last;
+
+			header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+
+			if (specifier.empty())
+				continue;
+
+			auto dash = specifier.find('-');
+
+			if (dash == std::string_view::npos)
+				return std::optional<std::vector<ByteRange>>();
+
+			if (!dash) //suffix range, the last n bytes
+			{
+				if (!number(specifier.substr(1), last))
+					return std::optional<std::vector<ByteRange>>();
+				if (!last || !size)
+					continue;
+				result.push_back({ size - std::min(last, size), size - 1 });
+			}
+			else
+			{
+				if (!number(specifier.substr(0, dash), first))
+					return std::optional<std::vector<ByteRange>>();
+				if (dash + 1 == specifier.size())
+					last = size - 1;
+				else if (!number(specifier.substr(dash + 1), last) || last < first)
+					return std::optional<std::vector<ByteRange>>();
+				if (first >= size)
+					continue;
+				result.push_back({ first, std::min(last, size - 1) });
+			}
+
+			if (result.size() > maxRanges * 4)
+				return std::optional<std::vector<ByteRange>>();
+		}
+
+		std::sort(result.begin(), result.end(), [](const ByteRange &lhs, const ByteRange &rhs) { return lhs.mFirst < rhs.mFirst; });
+
+		std::vector<ByteRange> merged;
+
+		for (const ByteRange &range : result)
+		{
+			if (!merged.empty() && range.mFirst <= merged.back().mLast + 1)
+				merged.back().mLast = std::max(merged.back().mLast, range.mLast);
+			else
+				merged.push_back(range);
+		}
+
+		if (merged.size() > maxRanges)
+			return std::optional<std::vector<ByteRange>>();
+
+		return merged;
+	}
+
+	//If-Range needs a strong match, so weak validators and dates other than the exact Last-Modified make the range request a full one
+	bool matchesIfRange(Request &request, std::string_view etag, std::int64_t lastWriteTime)
+	{
+		auto ifRange = request.getField(Request::HeaderField::IfRange);
+
+		if (!ifRange)
+			return true;
+
+		std::string_view value = trim(ifRange.value());
+
+		if (value.starts_with('"'))
+			return value == etag;
+		if (value.starts_with("W/"))
+			return false;
+
+		auto date = parseHttpDate(value);
+
+		return date && date.value() == lastWriteTime;
+	}
+
+	std::string makeContentRange(const ByteRange &range, std::uint64_t size)
+	{
+		return "bytes " + std::to_string(range.mFirst) + '-' + std::to_string(range.mLast) + '/' + std::to_string(size);
+	}
+
+	std::span<const std::uint8_t> asBytes(std::string_view text)
+	{
+		return std::span<const std::uint8_t>(reinterpret_cast<const std::uint8_t*>(text.data()), text.size());
+	}
+
+	bool equalsIgnoreCase(std::string_view lhs, std::string_view rhs)
+	{
+		return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](char l, char r) { return std::tolower(static_cast<unsigned char>(l)) == std::tolower(static_cast<unsigned char>(r)); });
+	}
+
+	//the q parameter of an Accept-Encoding element, 1 if it has none and an empty optional if it's malformed
+	std::optional<double> parseQuality(std::string_view parameters)
+	{
+		double quality = 1;
+
+		while (!parameters.empty())
+		{
+			auto semicolon = parameters.find(';');
+			std::string_view parameter = trim(parameters.substr(0, semicolon));
+			auto equals = parameter.find('=');
+
+			parameters.remove_prefix(semicolon == std::string_view::npos ? parameters.size() : semicolon + 1);
+
+			if (equals == std::string_view::npos || !equalsIgnoreCase(trim(parameter.substr(0, equals)), "q"))
+				continue;
+
+			std::string_view text = trim(parameter.substr(equals + 1));
+
+			if (text.empty() || std::from_chars(text.data(), text.data() + text.size(), quality).ptr != text.data() + text.size() || quality < 0 || quality > 1)
+				return std::optional<double>();
+		}
+
+		return quality;
+	}
+
+	//gzip is refused with a q value of 0, and when it isn't listed it's only accepted through a "*" that isn't refused
+	bool acceptsGzip(Request &request)
+	{
+		auto acceptEncoding = request.getField(Request::HeaderField::AcceptEncoding);
+		std::optional<bool> gzip, wildcard;
+
+		if (!acceptEncoding)
+			return false;
+
+		for (std::string_view value = acceptEncoding.value(); !value.empty();)
+		{
+			auto comma = value.find(',');
+			std::string_view element = value.substr(0, comma);
+			auto semicolon = element.find(';');
+			std::string_view coding = trim(element.substr(0, semicolon));
+			auto quality = parseQuality(semicolon == std::string_view::npos ? std::string_view() : element.substr(semicolon + 1));
+
+			value.remove_prefix(comma == std::string_view::npos ? value.size() : comma + 1);
+
+			if (!quality) //malformed elements are ignored
+				continue;
+			if (equalsIgnoreCase(coding, "gzip"))
+				gzip = quality.value() > 0;
+			else if (coding == "*")
+				wildcard = quality.value() > 0;
+		}
+
+		return gzip.value_or(wildcard.value_or(false));
+	}
+
+	void setKeepAlive(Request &request, Response &response)
+	{
+		auto connectionHeader = request.getField(Request::HeaderField::Connection);
+		std::string value(connectionHeader.value_or("close"));
+
+		std::transform(value.begin(), value.end(), value.begin(), [](char c) { return static_cast<char>(std::tolower(static_cast<unsigned char>(c))); });
+		response.setField(Response::HeaderField::Connection, value == "keep-alive" ? "keep-alive" : "close");
+	}
+
+	std::string removeEscapeSequences(std::string_view path)
+	{
+		std::string result;
+
+		result.reserve(path.size());
+		for (std::size_t i = 0; i < path.size(); ++i)
+		{
+			unsigned char decoded;
+
+			if (path[i] == '%' && i + 2 < path.size() && std::from_chars(path.data() + i + 1, path.data() + i + 3, decoded, 16).ec == std::errc())
+			{
+				result += static_cast<char>(decoded);
+				i += 2;
+			}
+			else
+				result += path[i];
+		}
+
+		return result;
+	}
+
+	bool isTraversal(std::string_view path)
+	{
+		return path.find('\0') != std::string_view::npos
+			|| path.find('\\') != std::string_view::npos
+			|| path == ".."
+			|| path.starts_with("../")
+			|| path.ends_with("/..")
+			|| path.find("/../") != std::string_view::npos;
+	}
+
+	void sendStatus(Request &request, Response &response, std::uint16_t code)
+	{
+		response.setStatusCode(code);
+		response.setField(Response::HeaderField::ContentLength, "0");
+		response.setField(Response::HeaderField::CacheControl, "no-store");
+		setKeepAlive(request, response);
+		response.send();
+	}
+}
+
+class Http::StaticFileHandler::Impl
+{
+public:
+	std::string mRoot, mPrefix, mCacheControl;
+
+	Impl(std::string_view, std::string_view, std::string_view);
+};
+
+Http::StaticFileHandler::Impl::Impl(std::string_view root, std::string_view prefix, std::string_view cacheControl)
+	:mRoot(root),
+	mPrefix(prefix),
+	mCacheControl(cacheControl)
+{
+	if (!mRoot.empty() && mRoot.back() != '/' && mRoot.back() != '\\')
+		mRoot += '/';
+}
+
+//---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//---------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+Http::StaticFileHandler::StaticFileHandler(std::string_view root, std::string_view prefix, std::string_view cacheControl)
+	:mThis(std::make_shared<const Impl>(root, prefix, cacheControl))
+{}
+
+void Http::StaticFileHandler::operator()(Request &request, Response &response) const
+{
+	std::string_view resource = request.getResourcePath();
+
+	if (!resource.starts_with(mThis->mPrefix))
+	{
+		sendStatus(request, response, 404);
+		return;
+	}
+
+	std::string relativePath = removeEscapeSequences(resource.substr(mThis->mPrefix.size()));
+
+	if (relativePath.empty() || relativePath.front() == '/' || isTraversal(relativePath))
+		sendStatus(request, response, 404);
+	else
+		serve(request, response, mThis->mRoot + relativePath, mThis->mCacheControl);
+}
+
+void Http::StaticFileHandler::serve(Request &request, Response &response, std::string_view path, std::string_view cacheControl)
+{
+	Request::Method method = request.getMethodId();
+
+	if (method != Request::Method::Get && method != Request::Method::Head)
+	{
+		sendMethodNotAllowed(request, response, getMethodBit(Request::Method::Get) | getMethodBit(Request::Method::Head));
+		return;
+	}
+
+	std::shared_ptr<const File> file; //what's sent when it isn't cached, the status comes from it too
+
+	try
+	{
+		file = FileDescriptorCache::getInstance().open(path);
+	}
+	catch (const std::system_error&)
+	{
+		sendStatus(request, response, 404);
+		return;
+	}
+
+	auto cached = FileCache::getInstance().get(path, file->getStatus());
+	const std::vector<std::uint8_t> *body = nullptr;
+	File::Status status = file->getStatus();
+	std::string etag, lastModified;
+
+	if (cached)
+	{
+		status = cached->mStatus;
+		etag = cached->mETag;
+		lastModified = cached->mLastModified;
+		body = &cached->mContents;
+
+		if (cached->mCompressed)
+		{
+			response.setField(Response::HeaderField::Vary, "Accept-Encoding");
+			if (acceptsGzip(request))
+			{
+				body = &cached->mCompressed.value();
+				etag.insert(etag.size() - 1, "-gzip"); //each encoding is a different representation, so it needs its own validator
+				response.setField(Response::HeaderField::ContentEncoding, "gzip");
+			}
+		}
+	}
+	else
+	{
+		etag = makeETag(status);
+		lastModified = formatHttpDate(status.lastWriteTime);
+	}
+
+	auto ifNoneMatch = request.getField(Request::HeaderField::IfNoneMatch);
+	auto ifModifiedSince = request.getField(Request::HeaderField::IfModifiedSince);
+	bool notModified = false;
+
+	if (ifNoneMatch) //If-Modified-Since is ignored when If-None-Match is present
+		notModified = matchesETag(ifNoneMatch.value(), etag);
+	else if (ifModifiedSince)
+	{
+		auto since = parseHttpDate(ifModifiedSince.value());
+		notModified = since && status.lastWriteTime <= since.value();
+	}
+
+	response.setField(Response::HeaderField::ETag, etag);
+	response.setField(Response::HeaderField::LastModified, lastModified);
+	response.setField(Response::HeaderField::CacheControl, cacheControl);
+	setKeepAlive(request, response);
+
+	if (notModified)
+	{
+		response.setStatusCode(304);
+		response.send();
+		return;
+	}
+
+	std::string_view mimeType = cached ? cached->mMimeType : getMimeType(path);
+	std::uint64_t size = body ? body->size() : status.size;
+	auto rangeHeader = request.getField(Request::HeaderField::Range);
+	std::optional<std::vector<ByteRange>> ranges;
+	auto sendRange = [&](const ByteRange &range) {
+		if (body)
+			response.sendBytes(std::span<const std::uint8_t>(*body).subspan(range.mFirst, range.mLast - range.mFirst + 1));
+		else
+			response.sendFile(*file, range.mFirst, range.mLast - range.mFirst + 1);
+	};
+
+	response.setField(Response::HeaderField::AcceptRanges, "bytes");
+
+	if (rangeHeader && method == Request::Method::Get && matchesIfRange(request, etag, status.lastWriteTime))
+		ranges = parseRange(rangeHeader.value(), size);
+
+	if (!ranges)
+	{
+		response.setStatusCode(200);
+		response.setField(Response::HeaderField::ContentType, mimeType);
+		response.setField(Response::HeaderField::ContentLength, std::to_string(size));
+		response.sendHeaders();
+
+		if (method == Request::Method::Get && size)
+			sendRange({ 0, size - 1 });
+	}
+	else if (ranges->empty())
+	{
+		response.setStatusCode(416);
+		response.setField(Response::HeaderField::ContentRange, "bytes */" + std::to_string(size));
+		response.setField(Response::HeaderField::ContentLength, "0");
+		response.send();
+	}
+	else if (ranges->size() == 1)
+	{
+		const ByteRange &range = ranges->front();
+
+		response.setStatusCode(206);
+		response.setField(Response::HeaderField::ContentType, mimeType);
+		response.setField(Response::HeaderField::ContentRange, makeContentRange(range, size));
+		response.setField(Response::HeaderField::ContentLength, std::to_string(range.mLast - range.mFirst + 1));
+		response.sendHeaders();
+		sendRange(range);
+	}
+	else
+	{
+		std::string boundary = "HTTPCPP" + etag.substr(1, etag.size() - 2);
+		std::string closingDelimiter = "\r\n--" + boundary + "--\r\n";
+		std::vector<std::string> partHeaders;
+		std::uint64_t contentLength = closingDelimiter.size();
+
+		partHeaders.reserve(ranges->size());
+		for (const ByteRange &range : ranges.value())
+		{
+			partHeaders.push_back("\r\n--" + boundary + "\r\nContent-Type: " + std::string(mimeType) + "\r\nContent-Range: " + makeContentRange(range, size) + "\r\n\r\n");
+			contentLength += partHeaders.back().size() + range.mLast - range.mFirst + 1;
+		}
+
+		response.setStatusCode(206);
+		response.setField(Response::HeaderField::ContentType, "multipart/byteranges; boundary=" + boundary);
+		response.setField(Response::HeaderField::ContentLength, std::to_string(contentLength));
+		response.sendHeaders();
+
+		for (std::size_t i = 0; i < ranges->size(); ++i)
+		{
+			response.sendBytes(asBytes(partHeaders[i]));
+			sendRange(ranges.value()[i]);
+		}
+
+		response.sendBytes(asBytes(closingDelimiter));
+	}
+}
+
+void Http::StaticFileHandler::setCacheLimits(std::size_t memoryBudget, std::size_t maxFileSize) noexcept
+{
+	FileCache::getInstance().setLimits(memoryBudget, maxFileSize);
+}
+
+void Http::StaticFileHandler::setDescriptorCacheLimits(std::chrono::milliseconds timeToLive, std::size_t maxOpenFiles) noexcept
+{
+	FileDescriptorCache::getInstance().setLimits(timeToLive, maxOpenFiles);
+}
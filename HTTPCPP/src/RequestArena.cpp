@@ -0,0 +1,78 @@
+#include "RequestArena.h"
+
+RequestArena::Upstream::Upstream(std::pmr::memory_resource *buffers) noexcept
+	:mBuffers(buffers)
+{}
+
+void* RequestArena::Upstream::do_allocate(std::size_t bytes, std::size_t alignment)
+{
+	void *block = mBuffers->allocate(bytes, alignment);
+	std::size_t held = mBytes.load(std::memory_order_relaxed) + bytes;
+
+	//only the thread serving the connection writes, loads and stores are enough
+	mBytes.store(held, std::memory_order_relaxed);
+	if (held > mPeakBytes.load(std::memory_order_relaxed))
+		mPeakBytes.store(held, std::memory_order_relaxed);
+
+	return block;
+}
+
+void RequestArena::Upstream::do_deallocate(void *buffer, std::size_t bytes, std::size_t alignment)
+{
+	mBuffers->deallocate(buffer, bytes, alignment);
+	mBytes.store(mBytes.load(std::memory_order_relaxed) - bytes, std::memory_order_relaxed);
+}
+
+bool RequestArena::Upstream::do_is_equal(const std::pmr::memory_resource &other) const noexcept
+{
+	return this == &other;
+}
+
+std::size_t RequestArena::Upstream::getBytes() const noexcept
+{
+	return mBytes.load(std::memory_order_relaxed);
+}
+
+std::size_t RequestArena::Upstream::getPeakBytes() const noexcept
+{
+	return mPeakBytes.load(std::memory_order_relaxed);
+}
+
+void RequestArena::Upstream::resetPeakBytes() noexcept
+{
+	mPeakBytes.store(mBytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+RequestArena::RequestArena(std::pmr::memory_resource *buffers)
+	:mUpstream(buffers)
+	,mResource(initialSize, &mUpstream) //nothing is taken from the buffers until the first allocation
+{}
+
+std::pmr::memory_resource* RequestArena::get() noexcept
+{
+	return &mResource;
+}
+
+void RequestArena::reset() noexcept
+{
+	mResource.release();
+}
+
+std::size_t RequestArena::getBytes() const noexcept
+{
+	return mUpstream.getBytes();
+}
+
+std::size_t RequestArena::getPeakBytes() const noexcept
+{
+	return mUpstream.getPeakBytes();
+}
+
+void RequestArena::resetPeakBytes() noexcept
+{
+	mUpstream.resetPeakBytes();
+}
@@ -0,0 +1,50 @@
+#ifndef __REQUESTARENA__
+#define __REQUESTARENA__
+#include <memory_resource>
+#include <atomic>
+#include <cstddef>
+
+//Memory for everything a request and its response allocate. Allocations bump a pointer and nothing is freed until reset,
+//which runs between the requests of a keep-alive connection and gives every block back to the buffer pool, so an arena
+//that's waiting for a request holds no memory at all. Not thread safe, a connection is served by one thread at a time,
+//the byte counts can be read from any thread.
+class RequestArena
+{
+	//counts the blocks the arena holds, for per connection accounting
+	class Upstream : public std::pmr::memory_resource
+	{
+		std::pmr::memory_resource *mBuffers;
+		std::atomic<std::size_t> mBytes = 0, mPeakBytes = 0;
+
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+		void do_deallocate(void *buffer, std::size_t bytes, std::size_t alignment) override;
+		bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+	public:
+		Upstream(std::pmr::memory_resource *buffers) noexcept;
+
+		std::size_t getBytes() const noexcept;
+		std::size_t getPeakBytes() const noexcept;
+		void resetPeakBytes() noexcept;
+	};
+
+	static constexpr std::size_t initialSize = 16 * 1024; //fits the headers of nearly every request and response
+
+	Upstream mUpstream;
+	std::pmr::monotonic_buffer_resource mResource;
+public:
+	//buffers must outlive the arena
+	RequestArena(std::pmr::memory_resource *buffers);
+	RequestArena(const RequestArena&) = delete;
+	RequestArena& operator=(const RequestArena&) = delete;
+
+	std::pmr::memory_resource* get() noexcept;
+	//everything allocated from the arena must have been destroyed
+	void reset() noexcept;
+	//taken from the buffers right now
+	std::size_t getBytes() const noexcept;
+	//most taken at once since the last resetPeakBytes
+	std::size_t getPeakBytes() const noexcept;
+	void resetPeakBytes() noexcept;
+};
+
+#endif
@@ -0,0 +1,167 @@
+#include "ResponseCache.h"
+#include "HttpRequest.h"
+#include <charconv>
+
+ResponseCache::ResponseCache(const Http::Server::ResponseCachePolicy &policy)
+	:mPolicy(policy)
+{}
+
+void ResponseCache::evict(std::chrono::steady_clock::time_point now)
+{
+	auto lifetime = mPolicy.mTimeToLive + mPolicy.mStaleWhileRevalidate;
+
+	for (auto slot = mEntries.begin(); slot != mEntries.end() && mEntries.size() >= mPolicy.mMaxEntries;)
+	{
+		if (!slot->second.mFilling && (!slot->second.mEntry || now - slot->second.mEntry->mStoredAt >= lifetime))
+			slot = mEntries.erase(slot);
+		else
+			++slot;
+	}
+
+	//everything is still in use, make room anyway
+	for (auto slot = mEntries.begin(); slot != mEntries.end() && mEntries.size() >= mPolicy.mMaxEntries;)
+	{
+		if (!slot->second.mFilling)
+			slot = mEntries.erase(slot);
+		else
+			++slot;
+	}
+}
+
+std::string ResponseCache::makeKey(Http::Request &request) const
+{
+	std::string key(request.getResourcePath());
+
+	//'\0' separates components, '\1' tells present but empty values apart from missing ones
+	for (const std::string &queryKey : mPolicy.mQueryKeys)
+	{
+		key += '\0';
+		if (auto value = request.getRequestStringValue(queryKey))
+		{
+			key += '\1';
+			key.append(value.value());
+		}
+	}
+
+	for (const std::string &field : mPolicy.mVaryFields)
+	{
+		key += '\0';
+		if (auto value = request.getField(field))
+		{
+			key += '\1';
+			key.append(value.value());
+		}
+	}
+
+	return key;
+}
+
+ResponseCache::Lookup ResponseCache::lookup(const std::string &key, bool canFill)
+{
+	std::unique_lock<std::mutex> lck(mMutex);
+	bool waited = false;
+
+	while (true)
+	{
+		auto now = std::chrono::steady_clock::now();
+		auto slot = mEntries.find(key);
+
+		if (slot == mEntries.end())
+		{
+			if (!canFill)
+				return { nullptr, false };
+
+			if (mEntries.size() >= mPolicy.mMaxEntries)
+				evict(now);
+			mEntries[key].mFilling = true;
+			return { nullptr, true };
+		}
+
+		if (const auto &entry = slot->second.mEntry)
+		{
+			auto age = now - entry->mStoredAt;
+
+			if (age < mPolicy.mTimeToLive)
+				return { entry, false };
+
+			if (age < mPolicy.mTimeToLive + mPolicy.mStaleWhileRevalidate)
+			{
+				bool fill = canFill && !slot->second.mFilling; //serve it stale, one request refreshes it afterwards
+
+				slot->second.mFilling |= fill;
+				return { entry, fill };
+			}
+		}
+
+		if (!slot->second.mFilling && canFill)
+		{
+			slot->second.mFilling = true;
+			return { nullptr, true };
+		}
+
+		//already waited for a fill that failed or was left uncached, don't queue up behind the next one
+		if (!canFill || waited)
+			return { nullptr, false };
+
+		mFilled.wait(lck);
+		waited = true;
+	}
+}
+
+void ResponseCache::store(const std::string &key, std::shared_ptr<const Entry> entry)
+{
+	{
+		std::lock_guard<std::mutex> lck(mMutex);
+		auto slot = mEntries.find(key);
+
+		if (slot != mEntries.end())
+		{
+			slot->second.mFilling = false;
+
+			if (entry && entry->mHead.starts_with("HTTP/1.1 200\r\n"))
+				slot->second.mEntry = std::move(entry);
+			else if (!slot->second.mEntry)
+				mEntries.erase(slot);
+		}
+	}
+
+	mFilled.notify_all();
+}
+
+std::shared_ptr<const ResponseCache::Entry> ResponseCache::makeEntry(std::string &&captured)
+{
+	auto headerEnd = captured.find("\r\n\r\n");
+
+	if (headerEnd == std::string::npos)
+		return nullptr;
+
+	auto entry = std::make_shared<Entry>();
+
+	entry->mBody = captured.substr(headerEnd + 4);
+	captured.resize(headerEnd + 2);
+	entry->mHead = std::move(captured);
+	entry->mStoredAt = std::chrono::steady_clock::now();
+
+	return entry;
+}
+
+std::pmr::string ResponseCache::serializeHead(const Entry &entry, std::optional<std::string_view> connection, std::pmr::memory_resource *resource)
+{
+	auto age = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - entry.mStoredAt);
+	std::pmr::string result(resource);
+	char ageText[24];
+
+	result.reserve(entry.mHead.size() + (connection ? connection->size() : 0) + 48);
+	result += entry.mHead;
+	if (connection)
+	{
+		result += "Connection: ";
+		result += connection.value();
+		result += "\r\n";
+	}
+	result += "Age: ";
+	result.append(ageText, std::to_chars(ageText, ageText + sizeof(ageText), age.count()).ptr);
+	result += "\r\n\r\n";
+
+	return result;
+}
@@ -0,0 +1,61 @@
+#ifndef __RESPONSECACHE__
+#define __RESPONSECACHE__
+#include <string>
+#include <memory_resource>
+#include <string_view>
+#include <optional>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include "HttpServer.h"
+
+//Serialized responses of a single route, keyed by path plus the query keys and request fields named in the policy.
+//Entries are served as is while fresh and for a while longer after that while a single request refreshes them.
+//Concurrent misses for the same key wait for the one request that runs the handler instead of running it themselves.
+class ResponseCache
+{
+public:
+	struct Entry
+	{
+		std::string mHead; //status line and fields, without Connection and the empty line that ends them
+		std::string mBody; //sent as is on every hit, never copied
+		std::chrono::steady_clock::time_point mStoredAt;
+	};
+
+	struct Lookup
+	{
+		std::shared_ptr<const Entry> mEntry; //nullptr on a miss
+		bool mFill; //the caller has to run the handler and pass the result to store, even if it throws
+	};
+private:
+	struct Slot
+	{
+		std::shared_ptr<const Entry> mEntry;
+		bool mFilling = false;
+	};
+
+	const Http::Server::ResponseCachePolicy mPolicy;
+	std::mutex mMutex;
+	std::condition_variable mFilled;
+	std::unordered_map<std::string, Slot> mEntries;
+
+	void evict(std::chrono::steady_clock::time_point now);
+public:
+	ResponseCache(const Http::Server::ResponseCachePolicy &policy);
+
+	std::string makeKey(Http::Request &request) const;
+	//blocks while another request fills a missing or expired entry. Requests that can't fill one, like HEAD, never wait.
+	Lookup lookup(const std::string &key, bool canFill);
+	//ends the fill started by lookup, entry is only kept if it's a 200 response. nullptr if the handler failed.
+	void store(const std::string &key, std::shared_ptr<const Entry> entry);
+
+	//nullptr if captured doesn't contain a full header
+	static std::shared_ptr<const Entry> makeEntry(std::string &&captured);
+	//the entry's head with the Connection and Age fields of this request and the empty line that ends it, allocated from resource.
+	//The body follows it separately.
+	static std::pmr::string serializeHead(const Entry &entry, std::optional<std::string_view> connection, std::pmr::memory_resource *resource);
+};
+
+#endif
@@ -0,0 +1,199 @@
+#include "Router.h"
+#include <algorithm>
+#include <stdexcept>
+
+struct Router::Node
+{
+	std::string mLabel; //literal text consumed by this node, empty for the root and parameter nodes
+	std::vector<std::unique_ptr<Node>> mChildren; //no two children start with the same character
+	std::unique_ptr<Node> mParameter;
+	std::string mParameterName;
+	std::unique_ptr<Route> mExact, mPrefix, mWildcard;
+};
+
+const Router::Handler* Router::Route::getHandler(Http::Request::Method method) const noexcept
+{
+	using Http::Request;
+
+	if (method != Request::Method::Other && mMethodHandlers[static_cast<std::size_t>(method)])
+		return &mMethodHandlers[static_cast<std::size_t>(method)];
+
+	if (method == Request::Method::Head && mMethodHandlers[static_cast<std::size_t>(Request::Method::Get)])
+		return &mMethodHandlers[static_cast<std::size_t>(Request::Method::Get)];
+
+	return mHandler ? &mHandler : nullptr;
+}
+
+Router::Node* Router::insertLiteral(Node *node, std::string_view text)
+{
+	while (!text.empty())
+	{
+		auto child = std::find_if(node->mChildren.begin(), node->mChildren.end(), [text](const std::unique_ptr<Node> &candidate) { return candidate->mLabel.front() == text.front(); });
+
+		if (child == node->mChildren.end())
+		{
+			node->mChildren.push_back(std::make_unique<Node>());
+			node->mChildren.back()->mLabel = text;
+			return node->mChildren.back().get();
+		}
+
+		std::size_t common = std::mismatch(text.begin(), text.end(), (*child)->mLabel.begin(), (*child)->mLabel.end()).first - text.begin();
+
+		if (common < (*child)->mLabel.size()) //split the edge where the new text diverges
+		{
+			auto intermediate = std::make_unique<Node>();
+
+			intermediate->mLabel = (*child)->mLabel.substr(0, common);
+			(*child)->mLabel.erase(0, common);
+			intermediate->mChildren.push_back(std::move(*child));
+			*child = std::move(intermediate);
+		}
+
+		node = child->get();
+		text.remove_prefix(common);
+	}
+
+	return node;
+}
+
+const Router::Route* Router::match(const Node &node, std::string_view path, Captures &captures)
+{
+	if (path.empty() && node.mExact)
+		return node.mExact.get();
+
+	if (!path.empty())
+	{
+		for (const auto &child : node.mChildren)
+		{
+			if (path.starts_with(child->mLabel))
+			{
+				if (const Route *route = match(*child, path.substr(child->mLabel.size()), captures))
+					return route;
+				break; //children start with different characters, no other one can match
+			}
+		}
+
+		if (node.mParameter && path.front() != '/')
+		{
+			std::string_view segment = path.substr(0, path.find('/'));
+
+			captures.emplace_back(node.mParameterName, segment);
+			if (const Route *route = match(*node.mParameter, path.substr(segment.size()), captures))
+				return route;
+			captures.pop_back();
+		}
+	}
+
+	if (node.mWildcard)
+	{
+		captures.emplace_back("*", path);
+		return node.mWildcard.get();
+	}
+
+	if (node.mPrefix && path.find('/') == std::string_view::npos) //prefix routes don't match paths that go deeper than their last segment
+		return node.mPrefix.get();
+
+	return nullptr;
+}
+
+Router::Router()
+	:mRoot(std::make_unique<Node>())
+{}
+
+Router::~Router() = default;
+
+Router::Router(Router&&) noexcept = default;
+
+Router& Router::operator=(Router&&) noexcept = default;
+
+Router::Route& Router::emplace(std::string_view pattern, Http::Server::RouteType type)
+{
+	Node *node = mRoot.get();
+	std::string_view rest = pattern;
+	bool wildcard = false;
+
+	if (pattern.empty() || pattern.front() != '/')
+		throw std::invalid_argument("Route patterns must start with '/'");
+
+	while (!rest.empty())
+	{
+		auto special = rest.find_first_of("{*");
+
+		node = insertLiteral(node, rest.substr(0, special));
+		rest.remove_prefix(special == std::string_view::npos ? rest.size() : special);
+
+		if (rest.empty())
+			break;
+
+		if (rest.front() == '*')
+		{
+			if (rest.size() != 1)
+				throw std::invalid_argument("'*' can only appear at the end of a route pattern");
+			wildcard = true;
+			break;
+		}
+
+		auto closingBrace = rest.find('}');
+		std::string_view name = rest.substr(1, closingBrace - 1);
+
+		if (closingBrace == std::string_view::npos || name.empty() || name.find_first_of("/{") != std::string_view::npos)
+			throw std::invalid_argument("Malformed parameter in route pattern");
+
+		if (!node->mParameter)
+		{
+			node->mParameter = std::make_unique<Node>();
+			node->mParameterName = name;
+		}
+		else if (node->mParameterName != name)
+			throw std::invalid_argument("Routes that share a parameter segment must give it the same name");
+
+		node = node->mParameter.get();
+		rest.remove_prefix(closingBrace + 1);
+	}
+
+	std::unique_ptr<Route> &slot = wildcard ? node->mWildcard : (type == Http::Server::RouteType::Exact ? node->mExact : node->mPrefix);
+
+	if (!slot)
+	{
+		slot = std::make_unique<Route>();
+		slot->mPattern = pattern;
+	}
+
+	return *slot;
+}
+
+void Router::insert(std::string_view pattern, Http::Server::RouteType type, std::optional<Http::Request::Method> method, const Handler &handler)
+{
+	using Http::Request;
+
+	if (method == Request::Method::Other)
+		throw std::invalid_argument("Handlers can only be registered for standard methods");
+
+	Route &route = emplace(pattern, type);
+
+	if (!method)
+	{
+		route.mHandler = handler;
+		return;
+	}
+
+	route.mMethodHandlers[static_cast<std::size_t>(*method)] = handler;
+	route.mAllowedMethods |= Http::getMethodBit(*method);
+	if (*method == Request::Method::Get)
+		route.mAllowedMethods |= Http::getMethodBit(Request::Method::Head);
+}
+
+void Router::setCache(std::string_view pattern, Http::Server::RouteType type, std::shared_ptr<ResponseCache> cache)
+{
+	emplace(pattern, type).mCache = std::move(cache);
+}
+
+void Router::setExecutor(std::string_view pattern, Http::Server::RouteType type, std::size_t executor)
+{
+	emplace(pattern, type).mExecutor = executor;
+}
+
+const Router::Route* Router::find(std::string_view path, Captures &captures) const
+{
+	return match(*mRoot, path, captures);
+}
@@ -0,0 +1,62 @@
+#ifndef __ROUTER__
+#define __ROUTER__
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+#include <memory>
+#include <functional>
+#include <array>
+#include <optional>
+#include "HttpServer.h"
+#include "HttpRequest.h"
+#include "HttpRouteTable.h"
+#include "ResponseCache.h"
+
+//Compressed radix tree of routes, lookups cost depends on the length of the path rather than on the number of routes.
+//Patterns are literal text with optional {name} segments, which match one non empty path segment, and an optional
+//trailing *, which matches the rest of the path. Captured values are views into the path being matched.
+class Router
+{
+public:
+	using Handler = std::function<Http::Server::HandlerCallback>;
+	using Captures = std::pmr::vector<std::pair<std::string_view, std::string_view>>; //name, value
+
+	struct Route
+	{
+		static constexpr std::size_t methodCount = static_cast<std::size_t>(Http::Request::Method::Other);
+		static constexpr std::size_t inlineExecutor = static_cast<std::size_t>(-1);
+
+		std::string mPattern;
+		Handler mHandler; //serves methods without a handler of their own
+		std::array<Handler, methodCount> mMethodHandlers;
+		std::uint32_t mAllowedMethods = 0; //for the Allow field of 405 responses, see Http::sendMethodNotAllowed
+		std::shared_ptr<ResponseCache> mCache; //nullptr unless enabled with Server::setResponseCache
+		std::size_t mExecutor = 0; //index of the pool that runs the handlers, 0 is the one connections start on
+
+		//HEAD falls back to the GET handler. nullptr if the method isn't allowed.
+		const Handler* getHandler(Http::Request::Method method) const noexcept;
+	};
+private:
+	struct Node;
+	std::unique_ptr<Node> mRoot;
+
+	static Node* insertLiteral(Node *node, std::string_view text);
+	Route& emplace(std::string_view pattern, Http::Server::RouteType type);
+	static const Route* match(const Node &node, std::string_view path, Captures &captures);
+public:
+	Router();
+	~Router();
+	Router(Router&&) noexcept;
+	Router& operator=(Router&&) noexcept;
+
+	//without a method the handler serves every method that has no handler of its own. Registering the same pattern and method
+	//twice replaces the handler. Throws std::invalid_argument if the pattern is malformed or method is Method::Other.
+	void insert(std::string_view pattern, Http::Server::RouteType type, std::optional<Http::Request::Method> method, const Handler &handler);
+	void setCache(std::string_view pattern, Http::Server::RouteType type, std::shared_ptr<ResponseCache> cache);
+	void setExecutor(std::string_view pattern, Http::Server::RouteType type, std::size_t executor);
+	//nullptr if no route matches. Exact matches win over prefix ones, literal segments over parameters, parameters over wildcards.
+	const Route* find(std::string_view path, Captures &captures) const;
+};
+
+#endif
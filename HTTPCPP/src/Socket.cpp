@@ -1,16 +1,23 @@
 #include "Socket.h"
+#include "TLSContext.h"
 #include <algorithm>
 #include <string>
 #include <array>
 #include <charconv>
+#include <utility>
 
 #ifdef _WIN32
 #include <Ws2tcpip.h>
 #include <credssp.h>
 #include <type_traits>
 #include <Schnlsp.h>
+#include <mswsock.h>
+#include <mstcpip.h>
 #elif defined __linux__
 #include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/sendfile.h>
 #include <sys/types.h>
 #include <netdb.h>
 #include <unistd.h>
@@ -18,6 +25,9 @@
 #include <poll.h>
 #include <cstring>
 #include <fcntl.h>
+#include <climits>
+#include <chrono>
+#include <openssl/err.h>
 #define SOCKET_ERROR (-1)
 #define INVALID_SOCKET (-1)
 #endif
@@ -36,7 +46,7 @@ namespace
 		result = message;
 		LocalFree(message);
 		#elif defined(__linux__)
-		result = std::strerror(msg);
+		result = std::strerror(code);
 		#endif
 
 		return result;
@@ -61,10 +71,67 @@ namespace
 		if (ret < 0)
 			throw SocketException(ret);
 	}
+
+	//largest token Schannel produces, queried once
+	unsigned long getMaxToken()
+	{
+		static const unsigned long maxToken = []
+		{
+			PSecPkgInfoA packageInfo;
+			unsigned long size;
+
+			checkSSPIReturn(QuerySecurityPackageInfoA(const_cast<char*>("Schannel"), &packageInfo));
+			size = packageInfo->cbMaxToken;
+			FreeContextBuffer(packageInfo);
+
+			return size;
+		}();
+
+		return maxToken;
+	}
 	#elif defined(__linux__)
 	using BufferType = void*;
 	using LengthType = size_t;
+
+	//throws the oldest error in OpenSSL's queue, which is emptied
+	[[noreturn]] void throwSSLError(const std::string &what)
+	{
+		char description[256] = {};
+
+		ERR_error_string_n(ERR_get_error(), description, sizeof(description));
+		ERR_clear_error();
+		throw SocketException(what + ": " + description);
+	}
+
+	//for an SSL_read or SSL_write that returned result
+	[[noreturn]] void throwIOError(SSL *session, int result)
+	{
+		int error = errno;
+
+		switch (SSL_get_error(session, result))
+		{
+			case SSL_ERROR_ZERO_RETURN:
+				throw SocketException("The other side closed the connection (close_notify received)");
+			case SSL_ERROR_WANT_READ:
+			case SSL_ERROR_WANT_WRITE: //the socket's timeout expired
+				throw SocketException(error ? error : EAGAIN);
+			case SSL_ERROR_SYSCALL:
+				if (error)
+					throw SocketException(error);
+				throw SocketException("The other side closed the connection without a close_notify");
+			default:
+				throwSSLError("TLS error");
+		}
+	}
 	#endif
+
+	constexpr std::string_view defaultServerProtocols = "\x08http/1.1"; //ALPN wire format
+
+	constexpr std::size_t smallRecordSize = 1400; //with the record's overhead it still fits a TCP segment, so the client can decrypt every packet as it arrives
+	constexpr std::size_t smallRecordBytes = 64 * 1024; //sent in small records before switching to full size ones, about what the congestion window grows to in a few round trips
+	constexpr std::chrono::milliseconds idleRecordReset(1000); //TCP restarts slow start after an idle period, small records start over too
+	constexpr std::size_t recordsPerWrite = 4; //full size records sent with one system call
+	constexpr std::size_t recordsPerRead = 4; //full size records one system call can receive
 }
 
 SocketException::SocketException(int code)
@@ -82,7 +149,7 @@ std::unique_ptr<addrinfo, decltype(freeaddrinfo)*> Socket::getAddressInfo(std::s
 	std::array<char, 6> strPort = {}; //Long enough for a 16 bit integer, plus a null character.
 	std::unique_ptr<addrinfo, decltype(freeaddrinfo)*> result(nullptr, freeaddrinfo);
 
-	addrinfo *list = nullptr, hint = { 0 };
+	addrinfo *list = nullptr, hint = {};
 	hint.ai_flags = flags;
 	hint.ai_family = mDomain; //IPv4
 	hint.ai_socktype = mType;
@@ -106,9 +173,6 @@ Socket::Socket(DescriptorType sock)
 {
 	#ifdef	_WIN32
 	using StructLength = int;
-	#elif defined __linux__
-	using StructLength = socklen_t;
-	#endif
 
 	struct
 	{
@@ -117,16 +181,25 @@ Socket::Socket(DescriptorType sock)
 	} state;
 	WSAPROTOCOL_INFOW protocolInfo;
 	StructLength typeLen = sizeof(socklen_t), stateLength = sizeof(state), protocolInfoLength = sizeof(protocolInfo);
+	#elif defined __linux__
+	socklen_t length = sizeof(int);
+	#endif
 
 	try
 	{
+		#ifdef _WIN32
 		checkReturn(getsockopt(mSocket, SOL_SOCKET, SO_PROTOCOL_INFO, reinterpret_cast<char*>(&protocolInfo), &protocolInfoLength));
 		checkReturn(getsockopt(mSocket, SOL_SOCKET, SO_TYPE, reinterpret_cast<char*>(&mType), &typeLen));
 		//This actually requires a buffer to hold a CSADDR_INFO plus two sockaddr structures, which will be pointed to by the lpSockaddr members of the LocalAddr and RemoteAddr members of the CSADDR_INFO structure
 		//more info: https://stackoverflow.com/questions/65782944/socket-option-so-bsp-state-fails-with-wsaefault
 		checkReturn(getsockopt(mSocket, SOL_SOCKET, SO_BSP_STATE, reinterpret_cast<char*>(&state), &stateLength));
-		mDomain = protocolInfo.iAddressFamily; //Could be retrieved with SO_DOMAIN option on linux.
+		mDomain = protocolInfo.iAddressFamily;
 		mProtocol = state.info.iProtocol;
+		#elif defined __linux__
+		checkReturn(getsockopt(mSocket, SOL_SOCKET, SO_DOMAIN, &mDomain, &length));
+		checkReturn(getsockopt(mSocket, SOL_SOCKET, SO_TYPE, &mType, &length));
+		checkReturn(getsockopt(mSocket, SOL_SOCKET, SO_PROTOCOL, &mProtocol, &length));
+		#endif
 	}
 	catch (const SocketException&)
 	{
@@ -150,11 +223,12 @@ Socket::Socket(int domain, int type, int protocol)
 }
 
 Socket::Socket(Socket &&other) noexcept
-	:mSocket(other.mSocket),
-	mLoader(std::move(other.mLoader)),
+	:mLoader(std::move(other.mLoader)),
+	mSocket(other.mSocket),
 	mDomain(other.mDomain),
 	mType(other.mType),
-	mProtocol(other.mProtocol)
+	mProtocol(other.mProtocol),
+	mNoDelay(other.mNoDelay)
 {
 	other.mSocket = INVALID_SOCKET;
 }
@@ -172,6 +246,7 @@ Socket& Socket::operator=(Socket &&other) noexcept
 	mDomain = other.mDomain;
 	mType = other.mType;
 	mProtocol = other.mProtocol;
+	mNoDelay = other.mNoDelay;
 
 	return *this;
 }
@@ -237,12 +312,55 @@ void Socket::setSocketOption(int level, int optionName, const void *optionValue,
 	#endif
 }
 
+void Socket::setNoDelay(bool toggle)
+{
+	int value = toggle;
+	setSocketOption(IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+	mNoDelay = toggle;
+}
+
+void Socket::setCork(bool toggle)
+{
+	#ifdef _WIN32
+	//there's no TCP_CORK on windows, turning Nagle's algorithm on while corked is the closest thing
+	int value = toggle ? 0 : mNoDelay;
+	setSocketOption(IPPROTO_TCP, TCP_NODELAY, &value, sizeof(value));
+	#elif defined (__linux__)
+	int value = toggle;
+	setSocketOption(IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+	#endif
+}
+
+std::optional<unsigned> Socket::getIncomingCpu() const noexcept
+{
+	#ifdef _WIN32
+	SOCKET_PROCESSOR_AFFINITY affinity;
+	DWORD bytesReturned;
+
+	if (!WSAIoctl(mSocket, SIO_QUERY_RSS_PROCESSOR_INFO, nullptr, 0, &affinity, sizeof(affinity), &bytesReturned, nullptr, nullptr))
+		return affinity.Processor.Group * 64u + affinity.Processor.Number;
+	#elif defined(__linux__) && defined(SO_INCOMING_CPU)
+	int cpu;
+	socklen_t length = sizeof(cpu);
+
+	if (!getsockopt(mSocket, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &length) && cpu >= 0)
+		return static_cast<unsigned>(cpu);
+	#endif
+
+	return std::nullopt;
+}
+
 Socket* Socket::accept()
+{
+	return new Socket(acceptDescriptor());
+}
+
+DescriptorType Socket::acceptDescriptor()
 {
 	DescriptorType clientSocket = ::accept(mSocket, nullptr, nullptr);
 
 	if (clientSocket != INVALID_SOCKET)
-		return new Socket(clientSocket);
+		return clientSocket;
 	else
 		#ifdef _WIN32
 		throw SocketException(WSAGetLastError());
@@ -280,40 +398,74 @@ std::int64_t Socket::send(const void *buffer, size_t bufferSize, int flags)
 	return result;
 }
 
-DescriptorType Socket::get() const noexcept
+std::uint64_t Socket::sendFile(const File &file, std::uint64_t offset, std::uint64_t count)
 {
-	return mSocket;
-}
-
-//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
-//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+	std::uint64_t sent = 0;
 
-CredHandle TLSSocket::acquireCredentials(std::string_view certificateStore, std::string_view certificateSubject) const
-{
-	using std::unique_ptr;
-	using std::remove_pointer;
-	unique_ptr<remove_pointer<HCERTSTORE>::type, std::function<BOOL __stdcall(HCERTSTORE)>> certificateStorePointer(nullptr, std::bind(CertCloseStore, std::placeholders::_1, CERT_CLOSE_STORE_FORCE_FLAG));
-	unique_ptr<const CERT_CONTEXT, decltype(CertFreeCertificateContext) *> certificate(nullptr, CertFreeCertificateContext);
-	CredHandle credentialsHandle = {};
+	#ifdef _WIN32
+	constexpr std::uint64_t maxTransmit = 0x7FFFFFFE; //TransmitFile can't send more than 2^31 - 2 bytes per call
+	std::unique_ptr<std::remove_pointer_t<HANDLE>, decltype(CloseHandle)*> event(CreateEventA(nullptr, TRUE, FALSE, nullptr), CloseHandle);
 
-	certificateStorePointer.reset(CertOpenSystemStoreA(NULL, certificateStore.data())/*CertOpenStore(CERT_STORE_PROV_SYSTEM, X509_ASN_ENCODING, 0, CERT_SYSTEM_STORE_LOCAL_MACHINE | CERT_STORE_READONLY_FLAG, L"MY")*/);
-	if (!certificateStorePointer)
+	if (!event)
 		throw SocketException(GetLastError());
 
-	certificate.reset(CertFindCertificateInStore(certificateStorePointer.get(), X509_ASN_ENCODING | PKCS_7_ASN_ENCODING, 0, CERT_FIND_SUBJECT_STR_A, certificateSubject.data(), NULL));
-	if (!certificate)
-		throw SocketException(GetLastError());
+	while (sent < count)
+	{
+		//the offset goes in the OVERLAPPED structure, so the file pointer of a shared handle isn't touched
+		OVERLAPPED overlapped = {};
+		DWORD transferred = 0, flags = 0;
+		std::uint64_t position = offset + sent;
+
+		overlapped.Offset = static_cast<DWORD>(position);
+		overlapped.OffsetHigh = static_cast<DWORD>(position >> 32);
+		overlapped.hEvent = event.get();
 
-	auto certPtr = certificate.get();
-	SCHANNEL_CRED schannelCredential = { .dwVersion = SCHANNEL_CRED_VERSION, .cCreds = 1, .paCred = &certPtr };
+		if (!TransmitFile(mSocket, file.get(), static_cast<DWORD>(std::min(count - sent, maxTransmit)), 0, &overlapped, nullptr, 0) && WSAGetLastError() != ERROR_IO_PENDING)
+			throw SocketException(WSAGetLastError());
+		if (!WSAGetOverlappedResult(mSocket, &overlapped, &transferred, TRUE, &flags))
+			throw SocketException(WSAGetLastError());
+		if (!transferred)
+			break; //file got shorter
+		sent += transferred;
+	}
+	#elif defined (__linux__)
+	off_t position = static_cast<off_t>(offset);
 
-	checkSSPIReturn(AcquireCredentialsHandleA(nullptr, const_cast<char *>("Schannel"), mRole == Role::SERVER ? SECPKG_CRED_INBOUND : SECPKG_CRED_OUTBOUND, nullptr, &schannelCredential, nullptr, nullptr, &credentialsHandle, nullptr));
+	while (sent < count)
+	{
+		ssize_t transferred = ::sendfile(mSocket, file.get(), &position, count - sent);
 
-	return credentialsHandle;
+		if (transferred == -1)
+		{
+			if (errno == EINTR)
+				continue;
+			throw SocketException(errno);
+		}
+		if (!transferred)
+			break; //file got shorter
+		sent += static_cast<std::uint64_t>(transferred);
+	}
+	#endif
+
+	return sent;
+}
+
+bool Socket::hasBufferedData() const noexcept
+{
+	return false;
 }
 
+DescriptorType Socket::get() const noexcept
+{
+	return mSocket;
+}
+
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+//-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
+
+#ifdef _WIN32
 unsigned long TLSSocket::getContextAttributes() const noexcept
 {
 	unsigned long result;
@@ -445,39 +597,160 @@ std::string TLSSocket::negotiate(CredHandle &credentialsHandle, SecHandle &conte
 	return extraData;
 }
 
-TLSSocket::TLSSocket(DescriptorType sock, std::string_view certificateStore, std::string_view certificateSubject, Role role, const std::optional<std::string> &principalName)
-	:Socket(sock),
+#elif defined(__linux__)
+void TLSSocket::createSession()
+{
+	if (!mContext)
+		mContext = std::make_shared<TLSContext>(mCertificateStore, mCertificateSubject, mRole);
+
+	std::unique_ptr<SSL, decltype(&SSL_free)> session(SSL_new(mContext->get()), SSL_free);
+
+	if (!session || SSL_set_fd(session.get(), mSocket) != 1)
+		throwSSLError("Can't create a TLS session");
+	SSL_set_app_data(session.get(), this);
+	//one read takes whatever has arrived, several records, instead of a header and then a record. They're decrypted in that buffer.
+	SSL_set_read_ahead(session.get(), 1);
+	SSL_set_default_read_buffer_len(session.get(), recordsPerRead * SSL3_RT_MAX_PACKET_SIZE);
+
+	if (mRole == Role::SERVER)
+		SSL_set_accept_state(session.get());
+	else
+	{
+		SSL_set_connect_state(session.get());
+		if (mPrincipalName)
+		{
+			if (SSL_set_tlsext_host_name(session.get(), mPrincipalName->c_str()) != 1 || SSL_set1_host(session.get(), mPrincipalName->c_str()) != 1)
+				throwSSLError("Can't set the server name");
+			SSL_set_verify(session.get(), SSL_VERIFY_PEER, nullptr);
+		}
+		if (!mApplicationProtocols.empty() && SSL_set_alpn_protos(session.get(), reinterpret_cast<const unsigned char*>(mApplicationProtocols.data()), static_cast<unsigned int>(mApplicationProtocols.size())))
+			throwSSLError("Can't set the application protocols");
+	}
+
+	mSession = session.release();
+}
+
+TLSSocket::HandshakeStatus TLSSocket::handshakeStep()
+{
+	mSessionBuffers = true;
+	ERR_clear_error();
+
+	int result = SSL_do_handshake(mSession);
+
+	if (result == 1)
+		return HandshakeStatus::Complete;
+
+	switch (SSL_get_error(mSession, result))
+	{
+		case SSL_ERROR_WANT_READ:
+			return HandshakeStatus::WantRead;
+		case SSL_ERROR_WANT_WRITE:
+			return HandshakeStatus::WantWrite;
+		default:
+			throwIOError(mSession, result);
+	}
+}
+
+void TLSSocket::handshake()
+{
+	timeval timeout = {};
+	socklen_t timeoutLength = sizeof(timeout);
+	bool nonBlocking = isNonBlocking();
+
+	checkReturn(getsockopt(mSocket, SOL_SOCKET, SO_RCVTIMEO, &timeout, &timeoutLength));
+
+	//no timeout waits forever, like receive does
+	bool expires = timeout.tv_sec || timeout.tv_usec;
+	auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout.tv_sec) + std::chrono::microseconds(timeout.tv_usec);
+
+	toggleNonBlockingMode(true);
+	try
+	{
+		for (HandshakeStatus status = handshakeStep(); status != HandshakeStatus::Complete; status = handshakeStep())
+		{
+			pollfd descriptor = { mSocket, static_cast<short>(status == HandshakeStatus::WantRead ? POLLIN : POLLOUT), 0 };
+			int wait = -1;
+
+			if (expires)
+			{
+				auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+
+				if (remaining <= 0)
+					throw SocketException(ETIMEDOUT);
+				wait = static_cast<int>(remaining);
+			}
+
+			if (poll(&descriptor, 1, wait) == SOCKET_ERROR && errno != EINTR)
+				throw SocketException(errno);
+		}
+	}
+	catch (...)
+	{
+		toggleNonBlockingMode(nonBlocking);
+		throw;
+	}
+
+	toggleNonBlockingMode(nonBlocking);
+}
+
+#endif
+
+TLSSocket::TLSSocket(Socket &&socket, std::string_view certificateStore, std::string_view certificateSubject, Role role, const std::optional<std::string> &principalName)
+	:Socket(std::move(socket)),
 	mCertificateStore(certificateStore),
 	mCertificateSubject(certificateSubject),
-	mRole(role),
-	mPrincipalName(principalName)
+	mPrincipalName(principalName),
+	mApplicationProtocols(role == Role::SERVER ? defaultServerProtocols : std::string_view()),
+	mRole(role)
 {}
 
 TLSSocket::TLSSocket(int domain, std::string_view certificateStore, std::string_view certificateSubject, Role role, const std::optional<std::string> &principalName)
 	:Socket(domain, SOCK_STREAM, IPPROTO_TCP),
 	mCertificateStore(certificateStore),
 	mCertificateSubject(certificateSubject),
-	mRole(role),
-	mPrincipalName(principalName)
+	mPrincipalName(principalName),
+	mApplicationProtocols(role == Role::SERVER ? defaultServerProtocols : std::string_view()),
+	mRole(role)
+{}
+
+TLSSocket::TLSSocket(Socket &&socket, std::shared_ptr<const TLSContext> context, const std::optional<std::string> &principalName)
+	:Socket(std::move(socket)),
+	mPrincipalName(principalName),
+	mApplicationProtocols(context->getRole() == Role::SERVER ? defaultServerProtocols : std::string_view()),
+	mRole(context->getRole()),
+	mContext(std::move(context))
 {}
 
+#ifdef _WIN32
 TLSSocket::TLSSocket(TLSSocket &&other) noexcept
 	:Socket(std::move(other)),
 	mCertificateStore(std::move(other.mCertificateStore)),
 	mCertificateSubject(std::move(other.mCertificateSubject)),
 	mExtraData(std::move(other.mExtraData)),
-	mCredentialsHandle(std::exchange(other.mCredentialsHandle, CredHandle {})),
+	mContext(std::move(other.mContext)),
 	mContextHandle(std::exchange(other.mContextHandle, SecHandle {})),
+	mHandshakeInput(std::move(other.mHandshakeInput)),
+	mHandshakeOutput(std::move(other.mHandshakeOutput)),
+	mHandshakeIncomplete(other.mHandshakeIncomplete),
+	mHandshakeFinished(other.mHandshakeFinished),
 	mStreamSizes(other.mStreamSizes),
+	mRecordBuffer(std::move(other.mRecordBuffer)),
+	mReceiveBuffer(std::move(other.mReceiveBuffer)),
+	mPlaintextBegin(other.mPlaintextBegin),
+	mPlaintextSize(std::exchange(other.mPlaintextSize, 0)),
+	mCipherBegin(std::exchange(other.mCipherBegin, 0)),
+	mCipherEnd(std::exchange(other.mCipherEnd, 0)),
+	mSentSinceIdle(other.mSentSinceIdle),
+	mLastSend(other.mLastSend),
 	mContextEstablished(other.mContextEstablished),
 	mRole(other.mRole),
-	mPrincipalName(other.mPrincipalName)
+	mPrincipalName(other.mPrincipalName),
+	mApplicationProtocols(std::move(other.mApplicationProtocols))
 {}
 
 TLSSocket::~TLSSocket()
 {
 	DeleteSecurityContext(&mContextHandle);
-	FreeCredentialsHandle(&mCredentialsHandle);
 }
 
 TLSSocket& TLSSocket::operator=(TLSSocket &&other) noexcept
@@ -486,22 +759,91 @@ TLSSocket& TLSSocket::operator=(TLSSocket &&other) noexcept
 	mCertificateStore = std::move(other.mCertificateStore);
 	mCertificateSubject = std::move(other.mCertificateSubject);
 	mExtraData = std::move(other.mExtraData);
-	mCredentialsHandle = std::exchange(other.mCredentialsHandle, CredHandle {});
+	DeleteSecurityContext(&mContextHandle);
+	mContext = std::move(other.mContext);
 	mContextHandle = std::exchange(other.mContextHandle, SecHandle {});
+	mHandshakeInput = std::move(other.mHandshakeInput);
+	mHandshakeOutput = std::move(other.mHandshakeOutput);
+	mHandshakeIncomplete = other.mHandshakeIncomplete;
+	mHandshakeFinished = other.mHandshakeFinished;
 	mStreamSizes = other.mStreamSizes;
+	mRecordBuffer = std::move(other.mRecordBuffer);
+	mReceiveBuffer = std::move(other.mReceiveBuffer);
+	mPlaintextBegin = other.mPlaintextBegin;
+	mPlaintextSize = std::exchange(other.mPlaintextSize, 0);
+	mCipherBegin = std::exchange(other.mCipherBegin, 0);
+	mCipherEnd = std::exchange(other.mCipherEnd, 0);
+	mSentSinceIdle = other.mSentSinceIdle;
+	mLastSend = other.mLastSend;
 	mContextEstablished = other.mContextEstablished;
 	mRole = other.mRole;
 	mPrincipalName = std::move(other.mPrincipalName);
+	mApplicationProtocols = std::move(other.mApplicationProtocols);
+
+	return *this;
+}
+
+#elif defined(__linux__)
+TLSSocket::TLSSocket(TLSSocket &&other) noexcept
+	:Socket(std::move(other)),
+	mCertificateStore(std::move(other.mCertificateStore)),
+	mCertificateSubject(std::move(other.mCertificateSubject)),
+	mExtraData(std::move(other.mExtraData)),
+	mPrincipalName(std::move(other.mPrincipalName)),
+	mApplicationProtocols(std::move(other.mApplicationProtocols)),
+	mRole(other.mRole),
+	mContextEstablished(other.mContextEstablished),
+	mContext(std::move(other.mContext)),
+	mSentSinceIdle(other.mSentSinceIdle),
+	mLastSend(other.mLastSend),
+	mSession(std::exchange(other.mSession, nullptr)),
+	mRecordSize(other.mRecordSize),
+	mSessionBuffers(std::exchange(other.mSessionBuffers, false))
+{
+	if (mSession)
+		SSL_set_app_data(mSession, this); //read by the ALPN callback
+}
+
+TLSSocket::~TLSSocket()
+{
+	SSL_free(mSession);
+}
+
+TLSSocket& TLSSocket::operator=(TLSSocket &&other) noexcept
+{
+	SSL_free(mSession);
+	*static_cast<Socket*>(this) = std::move(other);
+	mCertificateStore = std::move(other.mCertificateStore);
+	mCertificateSubject = std::move(other.mCertificateSubject);
+	mExtraData = std::move(other.mExtraData);
+	mPrincipalName = std::move(other.mPrincipalName);
+	mApplicationProtocols = std::move(other.mApplicationProtocols);
+	mRole = other.mRole;
+	mContextEstablished = other.mContextEstablished;
+	mContext = std::move(other.mContext);
+	mSentSinceIdle = other.mSentSinceIdle;
+	mLastSend = other.mLastSend;
+	mSession = std::exchange(other.mSession, nullptr);
+	mRecordSize = other.mRecordSize;
+	mSessionBuffers = std::exchange(other.mSessionBuffers, false);
+	if (mSession)
+		SSL_set_app_data(mSession, this);
 
 	return *this;
 }
 
+#endif
+
 TLSSocket* TLSSocket::accept()
 {
+	//loaded once for every socket this one accepts
+	if (!mContext)
+		mContext = std::make_shared<TLSContext>(mCertificateStore, mCertificateSubject, Role::SERVER);
+
 	DescriptorType clientSocket = ::accept(mSocket, nullptr, nullptr);
 
 	if (clientSocket != INVALID_SOCKET)
-		return new TLSSocket(clientSocket, mCertificateStore, mCertificateSubject, Role::SERVER);
+		return new TLSSocket(Socket(clientSocket), mContext);
 	else
 		#ifdef _WIN32
 		throw SocketException(WSAGetLastError());
@@ -510,181 +852,341 @@ TLSSocket* TLSSocket::accept()
 	#endif
 }
 
+#ifdef _WIN32
 std::string TLSSocket::receive(int flags)
 {
 	if (!mContextEstablished)
 		establishSecurityContext();
 
-	std::string result, message(mExtraData);
-	SecBuffer buffer[4] = {};
-	SecBufferDesc descriptor = { SECBUFFER_VERSION, 4, buffer };
-	std::int64_t bytesRead = mExtraData.size(), toRead = mStreamSizes.cbHeader;
-	SECURITY_STATUS returnValue;
+	std::string buffer(mStreamSizes.cbMaximumMessage, '\0'); //a whole record
 
-	message.resize(message.size() + toRead);
-	mExtraData.clear();
+	buffer.resize(receive(buffer.data(), buffer.size(), flags));
 
-	do
+	return buffer;
+}
+
+std::int64_t TLSSocket::receive(void *buffer, size_t bufferSize, int flags)
+{
+	if (!mContextEstablished)
+		establishSecurityContext();
+
+	std::byte *output = static_cast<std::byte*>(buffer);
+	std::size_t copied = 0;
+
+	if (!mReceiveBuffer)
+		mReceiveBuffer = std::make_unique<std::byte[]>(getReceiveCapacity());
+
+	while (copied < bufferSize)
 	{
-		if (buffer[1].BufferType == SECBUFFER_MISSING)
+		if (!mPlaintextSize && !decryptRecord())
 		{
-			toRead = buffer[1].cbBuffer;
-			message.resize(message.size() + toRead);
+			if (copied)
+				break; //what was decrypted is returned instead of waiting for more
+			fillReceiveBuffer();
+			continue;
 		}
 
-		std::int64_t read = Socket::receive(message.data() + bytesRead, toRead, 0);
+		std::size_t length = std::min(bufferSize - copied, mPlaintextSize);
 
-		bytesRead += read;
-		buffer[0].pvBuffer = message.data();
-		buffer[0].cbBuffer = message.size() - (toRead - read); //this used to be just message.size(), which assumes that I always receive toRead bytes, which is not always the case and would sometimes cause decrypt errors.
-		buffer[0].BufferType = SECBUFFER_DATA;
+		std::copy_n(mReceiveBuffer.get() + mPlaintextBegin, length, output + copied);
+		copied += length;
+		if (flags & MSG_PEEK && length)
+			break; //left where it is for the next receive
+		mPlaintextBegin += length;
+		mPlaintextSize -= length;
+	}
 
-		std::fill(std::begin(buffer) + 1, std::end(buffer), SecBuffer { .cbBuffer = 0, .BufferType = SECBUFFER_EMPTY, .pvBuffer = nullptr });
+	return copied;
+}
 
-		returnValue = DecryptMessage(&mContextHandle, &descriptor, 0, nullptr);
+std::size_t TLSSocket::getReceiveCapacity() const noexcept
+{
+	return recordsPerRead * (static_cast<std::size_t>(mStreamSizes.cbHeader) + mStreamSizes.cbMaximumMessage + mStreamSizes.cbTrailer);
+}
 
-		if (returnValue == SEC_I_RENEGOTIATE)
-		{
-			message = negotiate(mCredentialsHandle, mContextHandle, std::span (static_cast<std::byte *>(buffer[0].pvBuffer), bytesRead));
-			bytesRead = message.size(); //start again
-			toRead = mStreamSizes.cbHeader;
-			message.resize(message.size() + mStreamSizes.cbHeader);
-			returnValue = SEC_E_INCOMPLETE_MESSAGE; //so the loop is not exited
-		}
-		else if (returnValue == SEC_I_CONTEXT_EXPIRED)
-		{
-			DWORD shutdown = SCHANNEL_SHUTDOWN;
-			SecBuffer shutdownBuffer = { .cbBuffer = sizeof(shutdown), .BufferType = SECBUFFER_TOKEN, .pvBuffer = &shutdown };
-			SecBufferDesc shutdownBufferDescriptor = { .ulVersion = SECBUFFER_VERSION, .cBuffers = 1, .pBuffers = &shutdownBuffer };
+void TLSSocket::fillReceiveBuffer()
+{
+	std::byte *data = mReceiveBuffer.get();
+	std::size_t capacity = getReceiveCapacity();
 
-			checkSSPIReturn(ApplyControlToken(&mContextHandle, &shutdownBufferDescriptor));
-			negotiate(mCredentialsHandle, mContextHandle, std::span(static_cast<std::byte *>(buffer[0].pvBuffer), bytesRead));
-			throw SocketException { SEC_I_CONTEXT_EXPIRED };
-		}
-	} while (returnValue == SEC_E_INCOMPLETE_MESSAGE);
+	//the incomplete record at the end moves to the front to make room for the rest of it
+	if (mCipherBegin)
+	{
+		std::copy(data + mCipherBegin, data + mCipherEnd, data);
+		mCipherEnd -= mCipherBegin;
+		mCipherBegin = 0;
+	}
 
-	checkSSPIReturn(returnValue);
+	if (mCipherEnd == capacity)
+		throw SocketException("Received a TLS record larger than the maximum");
 
-	result.append(static_cast<std::string::value_type*>(buffer[1].pvBuffer), buffer[1].cbBuffer);
+	if (!mExtraData.empty())
+	{
+		std::size_t length = std::min(mExtraData.size(), capacity - mCipherEnd);
 
-	return result;
+		std::copy_n(reinterpret_cast<const std::byte*>(mExtraData.data()), length, data + mCipherEnd);
+		mExtraData.erase(0, length);
+		mCipherEnd += length;
+	}
+	else
+		mCipherEnd += static_cast<std::size_t>(Socket::receive(data + mCipherEnd, capacity - mCipherEnd, 0));
 }
 
-std::int64_t TLSSocket::receive(void *buffer, size_t, int flags)
+bool TLSSocket::decryptRecord()
 {
-	using std::byte;
+	std::byte *record = mReceiveBuffer.get() + mCipherBegin;
+	std::size_t length = mCipherEnd - mCipherBegin;
+	SecBuffer buffers[4] = {
+		{ .cbBuffer = static_cast<unsigned long>(length), .BufferType = SECBUFFER_DATA, .pvBuffer = record },
+		{ .cbBuffer = 0, .BufferType = SECBUFFER_EMPTY, .pvBuffer = nullptr },
+		{ .cbBuffer = 0, .BufferType = SECBUFFER_EMPTY, .pvBuffer = nullptr },
+		{ .cbBuffer = 0, .BufferType = SECBUFFER_EMPTY, .pvBuffer = nullptr }
+	};
+	SecBufferDesc descriptor = { SECBUFFER_VERSION, 4, buffers };
+	SECURITY_STATUS returnValue;
 
-	if (!mContextEstablished)
-		establishSecurityContext();
+	if (!length)
+		return false;
 
-	SecBuffer messageBuffer[4] = {};
-	SecBufferDesc messageBufferDescriptor = { .ulVersion = SECBUFFER_VERSION, .cBuffers = 4, .pBuffers = messageBuffer };
-	std::int64_t bytesRead = mExtraData.size(), bytesToRead = mStreamSizes.cbHeader;
-	SECURITY_STATUS returnValue;
+	returnValue = DecryptMessage(&mContextHandle, &descriptor, 0, nullptr);
 
-	std::copy(mExtraData.begin(), mExtraData.end(), static_cast<std::string::value_type*>(buffer));
-	mExtraData.clear();
+	if (returnValue == SEC_E_INCOMPLETE_MESSAGE)
+		return false;
+	else if (returnValue == SEC_I_RENEGOTIATE)
+	{
+		//what the handshake received past its end is decrypted next
+		mExtraData.insert(0, negotiate(*mContext->getCredentials(), mContextHandle, std::span(record, length)));
+		mCipherBegin = mCipherEnd = 0;
 
-	do
+		return false;
+	}
+	else if (returnValue == SEC_I_CONTEXT_EXPIRED)
 	{
-		if (messageBuffer[1].BufferType == SECBUFFER_MISSING)
-			bytesToRead = messageBuffer[1].cbBuffer;
+		DWORD shutdown = SCHANNEL_SHUTDOWN;
+		SecBuffer shutdownBuffer = { .cbBuffer = sizeof(shutdown), .BufferType = SECBUFFER_TOKEN, .pvBuffer = &shutdown };
+		SecBufferDesc shutdownBufferDescriptor = { .ulVersion = SECBUFFER_VERSION, .cBuffers = 1, .pBuffers = &shutdownBuffer };
+
+		checkSSPIReturn(ApplyControlToken(&mContextHandle, &shutdownBufferDescriptor));
+		negotiate(*mContext->getCredentials(), mContextHandle, std::span(record, length));
+		throw SocketException { SEC_I_CONTEXT_EXPIRED };
+	}
 
-		bytesRead += Socket::receive(static_cast<byte *>(buffer) + bytesRead, bytesToRead, 0);
-		messageBuffer[0].pvBuffer = buffer;
-		messageBuffer[0].cbBuffer = bytesRead; //this used to be just message.size(), which assumes that I always receive toRead bytes, which is not always the case and would sometimes cause decrypt errors.
-		messageBuffer[0].BufferType = SECBUFFER_DATA;
+	checkSSPIReturn(returnValue);
 
-		for (std::size_t i = 1; i < sizeof(messageBuffer) / sizeof(*messageBuffer); ++i)
+	//the plaintext is inside the record, the records after it are left as they are
+	mPlaintextSize = 0;
+	mCipherBegin = mCipherEnd;
+	for (const SecBuffer &buffer : buffers)
+	{
+		if (buffer.BufferType == SECBUFFER_DATA)
 		{
-			messageBuffer[i].pvBuffer = nullptr;
-			messageBuffer[i].cbBuffer = 0;
-			messageBuffer[i].BufferType = SECBUFFER_EMPTY;
+			mPlaintextBegin = static_cast<std::size_t>(static_cast<std::byte*>(buffer.pvBuffer) - mReceiveBuffer.get());
+			mPlaintextSize = buffer.cbBuffer;
 		}
+		else if (buffer.BufferType == SECBUFFER_EXTRA)
+			mCipherBegin = mCipherEnd - buffer.cbBuffer; //counted from the end, its pvBuffer isn't always set
+	}
 
-		returnValue = DecryptMessage(&mContextHandle, &messageBufferDescriptor, 0, nullptr);
+	return true;
+}
 
-		if (returnValue == SEC_I_RENEGOTIATE)
+std::int64_t TLSSocket::send(const void *buffer, size_t bufferSize, int flags)
+{
+	if (!mContextEstablished)
+		establishSecurityContext();
+
+	const std::byte *data = static_cast<const std::byte*>(buffer);
+	std::size_t overhead = static_cast<std::size_t>(mStreamSizes.cbHeader) + mStreamSizes.cbTrailer;
+	std::size_t capacity = recordsPerWrite * (overhead + mStreamSizes.cbMaximumMessage);
+	std::size_t sent = 0;
+
+	if (!mRecordBuffer)
+		mRecordBuffer = std::make_unique<std::byte[]>(capacity);
+
+	while (sent < bufferSize)
+	{
+		std::size_t filled = 0, written = 0;
+
+		//header, data and trailer of each record are contiguous and records follow each other, the whole batch leaves in one call
+		while (sent < bufferSize && capacity - filled > overhead)
 		{
-			auto extraData = negotiate(mCredentialsHandle, mContextHandle, std::span(static_cast<std::byte *>(buffer), bytesRead));
-			std::copy(extraData.begin(), extraData.end(), static_cast<std::string::value_type*>(buffer));
-			bytesRead = extraData.size(); //start again
-			bytesToRead = mStreamSizes.cbHeader;
-			returnValue = SEC_E_INCOMPLETE_MESSAGE; //so the loop is not exited
+			std::byte *record = mRecordBuffer.get() + filled;
+			std::size_t recordSize = std::min({ getRecordSize(mStreamSizes.cbMaximumMessage), bufferSize - sent, capacity - filled - overhead });
+			SecBuffer secBuffer[4] = {
+				{ .cbBuffer = mStreamSizes.cbHeader, .BufferType = SECBUFFER_STREAM_HEADER, .pvBuffer = record },
+				{ .cbBuffer = static_cast<unsigned long>(recordSize), .BufferType = SECBUFFER_DATA, .pvBuffer = record + mStreamSizes.cbHeader },
+				{ .cbBuffer = mStreamSizes.cbTrailer, .BufferType = SECBUFFER_STREAM_TRAILER, .pvBuffer = record + mStreamSizes.cbHeader + recordSize },
+				{ .cbBuffer = 0, .BufferType = SECBUFFER_EMPTY, .pvBuffer = nullptr }
+			};
+			SecBufferDesc descriptor = { SECBUFFER_VERSION, 4, secBuffer };
+
+			std::copy(data + sent, data + sent + recordSize, record + mStreamSizes.cbHeader);
+			checkSSPIReturn(EncryptMessage(&mContextHandle, 0, &descriptor, 0));
+			filled += secBuffer[0].cbBuffer + secBuffer[1].cbBuffer + secBuffer[2].cbBuffer; //the trailer can be shorter than its maximum
+			sent += recordSize;
+			mSentSinceIdle += recordSize;
 		}
-		else if (returnValue == SEC_I_CONTEXT_EXPIRED)
-		{
-			DWORD shutdown = SCHANNEL_SHUTDOWN;
-			SecBuffer shutdownBuffer = { .cbBuffer = sizeof(shutdown), .BufferType = SECBUFFER_TOKEN, .pvBuffer = &shutdown };
-			SecBufferDesc shutdownBufferDescriptor = { .ulVersion = SECBUFFER_VERSION, .cBuffers = 1, .pBuffers = &shutdownBuffer };
 
-			checkSSPIReturn(ApplyControlToken(&mContextHandle, &shutdownBufferDescriptor));
-			negotiate(mCredentialsHandle, mContextHandle, std::span(static_cast<std::byte *>(messageBuffer[0].pvBuffer), bytesRead));
-			throw SocketException { SEC_I_CONTEXT_EXPIRED };
-		}
-	} while (returnValue == SEC_E_INCOMPLETE_MESSAGE);
+		while (written < filled)
+			written += static_cast<std::size_t>(Socket::send(mRecordBuffer.get() + written, filled - written, flags));
+	}
 
-	checkSSPIReturn(returnValue);
+	return bufferSize;
+}
 
-	for (decltype(SecBuffer::cbBuffer) i = 0; i < messageBuffer[1].cbBuffer; ++i) //Move the bytes of the decrypted message to the beginning of the buffer
-		static_cast<byte *>(messageBuffer[0].pvBuffer)[i] = static_cast<byte *>(messageBuffer[1].pvBuffer)[i];
+#elif defined(__linux__)
+std::string TLSSocket::receive(int flags)
+{
+	std::string buffer(SSL3_RT_MAX_PLAIN_LENGTH, '\0'); //a whole record
 
-	return messageBuffer[1].cbBuffer;
+	buffer.resize(receive(buffer.data(), buffer.size(), flags));
+
+	return buffer;
 }
 
-std::int64_t TLSSocket::send(const void *buffer, size_t bufferSize, int flags)
+std::int64_t TLSSocket::receive(void *buffer, size_t bufferSize, int flags)
 {
 	if (!mContextEstablished)
 		establishSecurityContext();
 
-	SecBuffer secBuffer[4];
-	SecBufferDesc descriptor = { SECBUFFER_VERSION, 4, secBuffer };
-	std::unique_ptr<std::byte[]> header(std::make_unique<std::byte[]>(mStreamSizes.cbHeader)), trailer(std::make_unique<std::byte[]>(mStreamSizes.cbTrailer));
-	std::int64_t sent = 0;
-
-	secBuffer[0].BufferType = SECBUFFER_STREAM_HEADER;
-	secBuffer[0].pvBuffer = header.get();
-	secBuffer[0].cbBuffer = mStreamSizes.cbHeader;
-	secBuffer[1].BufferType = SECBUFFER_DATA;
-	secBuffer[2].BufferType = SECBUFFER_STREAM_TRAILER;
-	secBuffer[2].pvBuffer = trailer.get();
-	secBuffer[2].cbBuffer = mStreamSizes.cbTrailer;
-	secBuffer[3].BufferType = SECBUFFER_EMPTY;
-	secBuffer[3].pvBuffer = nullptr;
-	secBuffer[3].cbBuffer = 0;
+	if (!bufferSize)
+		return 0;
+
+	int length = static_cast<int>(std::min<size_t>(bufferSize, INT_MAX));
+	int result;
+
+	mSessionBuffers = true;
+	ERR_clear_error();
+	result = flags & MSG_PEEK ? SSL_peek(mSession, buffer, length) : SSL_read(mSession, buffer, length);
+	if (result <= 0)
+		throwIOError(mSession, result);
+
+	return result;
+}
+
+std::int64_t TLSSocket::send(const void *buffer, size_t bufferSize, int)
+{
+	if (!mContextEstablished)
+		establishSecurityContext();
+
+	size_t sent = 0;
+	BIO *socket = SSL_get_wbio(mSession);
+
+	//records collect in a buffer in front of the socket and leave together instead of one write each. The kernel makes its own records.
+	if (BIO_method_type(socket) != BIO_TYPE_BUFFER && !hasKernelOffload())
+	{
+		BIO *records = BIO_new(BIO_f_buffer());
+
+		if (!records || BIO_set_write_buffer_size(records, recordsPerWrite * SSL3_RT_MAX_PACKET_SIZE) != 1)
+		{
+			BIO_free(records);
+			throwSSLError("Can't create the record buffer");
+		}
+		BIO_up_ref(socket); //the read side keeps its reference
+		SSL_set0_wbio(mSession, BIO_push(records, socket));
+	}
 
+	//OpenSSL cuts what it's given into records of at most mRecordSize
+	mSessionBuffers = true;
 	while (sent < bufferSize)
 	{
-		auto bytesToSend = std::min<size_t>(mStreamSizes.cbMaximumMessage, bufferSize - sent);
-		auto message { std::make_unique<std::byte[]>(bytesToSend) };
+		std::size_t recordSize = getRecordSize(SSL3_RT_MAX_PLAIN_LENGTH), length = bufferSize - sent;
+		int result;
 
-		secBuffer[1].pvBuffer = message.get();
-		secBuffer[1].cbBuffer = bytesToSend;
-		std::copy(static_cast<const std::byte *>(buffer) + sent, static_cast<const std::byte *>(buffer) + sent + bytesToSend, message.get());
-		checkSSPIReturn(EncryptMessage(&mContextHandle, 0, &descriptor, 0));
-		sent += bytesToSend;
+		if (recordSize < SSL3_RT_MAX_PLAIN_LENGTH)
+			length = std::min(length, smallRecordBytes - mSentSinceIdle);
+		if (recordSize != mRecordSize)
+		{
+			//lowering the maximum lowers the split fragment too, raising it doesn't
+			SSL_set_max_send_fragment(mSession, static_cast<long>(recordSize));
+			SSL_set_split_send_fragment(mSession, static_cast<long>(recordSize));
+			mRecordSize = recordSize;
+		}
 
-		for (int i = 0; i < sizeof(secBuffer) / sizeof(*secBuffer) - 1; ++i)
-			Socket::send(secBuffer[i].pvBuffer, secBuffer[i].cbBuffer, flags);
+		ERR_clear_error();
+		result = SSL_write(mSession, static_cast<const std::byte*>(buffer) + sent, static_cast<int>(std::min<size_t>(length, INT_MAX)));
+		if (result <= 0)
+			throwIOError(mSession, result);
+		sent += result;
+		mSentSinceIdle += result;
 	}
 
+	if (BIO_flush(SSL_get_wbio(mSession)) <= 0)
+		throw SocketException(errno ? errno : EIO);
+
 	return bufferSize;
 }
 
+#endif
+
+std::uint64_t TLSSocket::sendFile(const File &file, std::uint64_t offset, std::uint64_t count)
+{
+	if (!mContextEstablished)
+		establishSecurityContext();
+
+	std::uint64_t sent = 0;
+
+	#ifdef _WIN32
+	std::size_t chunkSize = mStreamSizes.cbMaximumMessage;
+	#elif defined(__linux__)
+	constexpr std::size_t chunkSize = 4 * SSL3_RT_MAX_PLAIN_LENGTH; //four full records per write
+
+	if (hasKernelOffload())
+	{
+		//the kernel encrypts the pages on their way out, the file never reaches user space
+		while (sent < count)
+		{
+			ossl_ssize_t transferred;
+
+			ERR_clear_error();
+			transferred = SSL_sendfile(mSession, file.get(), static_cast<off_t>(offset + sent), static_cast<size_t>(count - sent), 0);
+			if (transferred < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				throwIOError(mSession, static_cast<int>(transferred));
+			}
+			if (!transferred)
+				break; //file got shorter
+			sent += static_cast<std::uint64_t>(transferred);
+		}
+
+		return sent;
+	}
+	#endif
+	std::unique_ptr<std::byte[]> chunk(std::make_unique<std::byte[]>(chunkSize));
+
+	while (sent < count)
+	{
+		std::size_t bytesRead = file.read(chunk.get(), static_cast<std::size_t>(std::min<std::uint64_t>(chunkSize, count - sent)), offset + sent);
+
+		if (!bytesRead)
+			break; //file got shorter
+		send(chunk.get(), bytesRead);
+		sent += bytesRead;
+	}
+
+	return sent;
+}
+
+#ifdef _WIN32
 void TLSSocket::establishSecurityContext()
 {
 	using std::remove_pointer;
 	using std::unique_ptr;
 	if (mContextEstablished)
 		return;
+	if (mContextHandle.dwLower || mContextHandle.dwUpper)
+		throw SocketException("The handshake was started with continueHandshake, it has to be finished with it");
+
+	if (!mContext)
+		mContext = std::make_shared<TLSContext>(mCertificateStore, mCertificateSubject, mRole);
 
-	CredHandle credentialsHandle { acquireCredentials(mCertificateStore, mCertificateSubject) };
 	SecHandle contextHandle = {};
 
 	try
 	{
-		mExtraData = negotiate(credentialsHandle, contextHandle);
-		mCredentialsHandle = credentialsHandle;
+		mExtraData = negotiate(*mContext->getCredentials(), contextHandle);
 		mContextHandle = contextHandle;
 		mContextEstablished = true;
 	}
@@ -692,11 +1194,111 @@ void TLSSocket::establishSecurityContext()
 	{
 		mExtraData.clear();
 		DeleteSecurityContext(&contextHandle);
-		FreeCredentialsHandle(&credentialsHandle);
 		throw;
 	}
 }
 
+TLSSocket::HandshakeStatus TLSSocket::continueHandshake()
+{
+	if (mContextEstablished)
+		return HandshakeStatus::Complete;
+
+	if (!mContext)
+		mContext = std::make_shared<TLSContext>(mCertificateStore, mCertificateSubject, mRole);
+
+	while (true)
+	{
+		//tokens go out in the order they were made, nothing more is read until the last one is sent
+		while (!mHandshakeOutput.empty())
+		{
+			int sent = ::send(mSocket, mHandshakeOutput.data(), static_cast<int>(mHandshakeOutput.size()), 0);
+
+			if (sent == SOCKET_ERROR)
+			{
+				if (WSAGetLastError() == WSAEWOULDBLOCK)
+					return HandshakeStatus::WantWrite;
+				throw SocketException(WSAGetLastError());
+			}
+			mHandshakeOutput.erase(0, sent);
+		}
+
+		if (mHandshakeFinished)
+		{
+			mContextEstablished = true;
+			return HandshakeStatus::Complete;
+		}
+
+		bool started = mContextHandle.dwLower || mContextHandle.dwUpper;
+
+		//a client's first token is made from nothing, every other one answers what the other side sent
+		if ((mRole == Role::SERVER || started) && (mHandshakeInput.empty() || mHandshakeIncomplete))
+		{
+			char buffer[4096];
+			int received = ::recv(mSocket, buffer, sizeof(buffer), 0);
+
+			if (received == SOCKET_ERROR)
+			{
+				if (WSAGetLastError() == WSAEWOULDBLOCK)
+					return HandshakeStatus::WantRead;
+				throw SocketException(WSAGetLastError());
+			}
+			if (!received)
+				throw SocketException("The other side closed the connection during the handshake");
+			mHandshakeInput.append(buffer, received);
+			mHandshakeIncomplete = false;
+		}
+
+		unsigned long maxToken = getMaxToken();
+		std::unique_ptr<std::byte[]> outputBufferMemory { std::make_unique<std::byte[]>(maxToken) };
+		SecBuffer inputBuffer[2] = { { .cbBuffer = static_cast<unsigned long>(mHandshakeInput.size()), .BufferType = SECBUFFER_TOKEN, .pvBuffer = mHandshakeInput.data() }, { .cbBuffer = 0, .BufferType = SECBUFFER_EMPTY, .pvBuffer = nullptr } };
+		SecBuffer outputBuffer = { .cbBuffer = maxToken, .BufferType = SECBUFFER_TOKEN, .pvBuffer = outputBufferMemory.get() };
+		SecBufferDesc inputBufferDescriptor = { .ulVersion = SECBUFFER_VERSION, .cBuffers = 2, .pBuffers = inputBuffer };
+		SecBufferDesc outputBufferDescriptor = { .ulVersion = SECBUFFER_VERSION, .cBuffers = 1, .pBuffers = &outputBuffer };
+		ULONG returnedAttributes = 0;
+		SECURITY_STATUS result;
+
+		if (mRole == Role::SERVER)
+			result = AcceptSecurityContext(mContext->getCredentials(), started ? &mContextHandle : nullptr, &inputBufferDescriptor, getContextAttributes(), 0, &mContextHandle, &outputBufferDescriptor, &returnedAttributes, nullptr);
+		else
+			result = InitializeSecurityContextA(mContext->getCredentials(), started ? &mContextHandle : nullptr, mPrincipalName ? mPrincipalName.value().data() : nullptr, getContextAttributes(), 0, 0, started ? &inputBufferDescriptor : nullptr, 0, &mContextHandle, &outputBufferDescriptor, &returnedAttributes, nullptr);
+
+		switch (result)
+		{
+			case SEC_E_INCOMPLETE_MESSAGE:
+				mHandshakeIncomplete = true;
+				continue;
+			case SEC_I_COMPLETE_NEEDED:
+			case SEC_I_COMPLETE_AND_CONTINUE:
+				checkSSPIReturn(CompleteAuthToken(&mContextHandle, &outputBufferDescriptor));
+				break;
+			case SEC_E_OK:
+			case SEC_I_CONTINUE_NEEDED:
+				break;
+			default:
+				checkSSPIReturn(result);
+				throw SocketException { result };
+		}
+
+		//what wasn't consumed starts the next message, or is application data once the handshake is over
+		if (inputBuffer[1].BufferType == SECBUFFER_EXTRA)
+			mHandshakeInput.erase(0, mHandshakeInput.size() - inputBuffer[1].cbBuffer);
+		else
+			mHandshakeInput.clear();
+
+		if (outputBuffer.BufferType == SECBUFFER_TOKEN)
+			mHandshakeOutput.append(static_cast<const char*>(outputBuffer.pvBuffer), outputBuffer.cbBuffer);
+
+		if (result == SEC_E_OK || result == SEC_I_COMPLETE_NEEDED)
+		{
+			if (returnedAttributes != getContextAttributes())
+				throw SocketException("The established context does not satisfy the requested attributes");
+			checkSSPIReturn(QueryContextAttributes(&mContextHandle, SECPKG_ATTR_STREAM_SIZES, &mStreamSizes));
+			mExtraData = std::exchange(mHandshakeInput, std::string());
+			mHandshakeFinished = true;
+		}
+	}
+}
+
 //https://docs.microsoft.com/en-us/windows/win32/secauthn/renegotiating-an-schannel-connection
 void TLSSocket::requestRenegotiate()
 {
@@ -718,32 +1320,31 @@ void TLSSocket::requestRenegotiate()
 	ULONG returnedAttributes = 0;
 
 	if (mRole == Role::SERVER)
-		returnValue = AcceptSecurityContext(&mCredentialsHandle, &mContextHandle, nullptr, getContextAttributes(), 0, nullptr, &outputBufferDescriptor, &returnedAttributes, nullptr);
+		returnValue = AcceptSecurityContext(mContext->getCredentials(), &mContextHandle, nullptr, getContextAttributes(), 0, nullptr, &outputBufferDescriptor, &returnedAttributes, nullptr);
 	else if (mRole == Role::CLIENT)
-		returnValue = InitializeSecurityContextA(&mCredentialsHandle, &mContextHandle, mPrincipalName ? mPrincipalName.value().data() : nullptr, getContextAttributes(), 0, 0, nullptr, 0, nullptr, &outputBufferDescriptor, &returnedAttributes, nullptr);
+		returnValue = InitializeSecurityContextA(mContext->getCredentials(), &mContextHandle, mPrincipalName ? mPrincipalName.value().data() : nullptr, getContextAttributes(), 0, 0, nullptr, 0, nullptr, &outputBufferDescriptor, &returnedAttributes, nullptr);
 
 	std::string_view alert { static_cast<char*>(outputBuffer[1].pvBuffer), outputBuffer[1].cbBuffer };
 
 	checkSSPIReturn(returnValue);
 	Socket::send(outputBuffer[0].pvBuffer, outputBuffer[0].cbBuffer);
-	mExtraData = negotiate(mCredentialsHandle, mContextHandle);
+	mExtraData = negotiate(*mContext->getCredentials(), mContextHandle);
 }
 
 void TLSSocket::requestRenegotiate(std::string_view certificateStore, std::string_view certificateSubject)
 {
-	auto newCredentials { acquireCredentials(certificateStore, certificateSubject) };
-	auto oldCredentials = mCredentialsHandle;
+	//only this connection moves to the new credentials, the shared context stays as it is
+	auto oldContext = std::exchange(mContext, std::make_shared<TLSContext>(certificateStore, certificateSubject, mRole));
 
-	mCredentialsHandle = newCredentials;
 	try
 	{
 		requestRenegotiate();
-		FreeCredentialsHandle(&oldCredentials); //If the renegotiation succeeded, free the old credentials
+		mCertificateStore = certificateStore;
+		mCertificateSubject = certificateSubject;
 	}
 	catch (const SocketException&)
 	{
-		mCredentialsHandle = oldCredentials;
-		FreeCredentialsHandle(&newCredentials); //If the renegotiation failed, free the new credentials
+		mContext = std::move(oldContext); //If the renegotiation failed, keep the old credentials
 		throw;
 	}
 }
@@ -777,6 +1378,194 @@ void TLSSocket::shutdownConnection()
 			throw;
 	}
 }
+#elif defined(__linux__)
+void TLSSocket::establishSecurityContext()
+{
+	if (mContextEstablished)
+		return;
+
+	if (!mSession)
+		createSession();
+
+	handshake();
+	mContextEstablished = true;
+}
+
+TLSSocket::HandshakeStatus TLSSocket::continueHandshake()
+{
+	if (mContextEstablished)
+		return HandshakeStatus::Complete;
+
+	if (!mSession)
+		createSession();
+
+	HandshakeStatus status = handshakeStep();
+
+	mContextEstablished = status == HandshakeStatus::Complete;
+	return status;
+}
+
+void TLSSocket::requestRenegotiate()
+{
+	if (!mContextEstablished)
+		throw SocketException("A security context must be established before a new handshake can be performed");
+
+	ERR_clear_error();
+	//TLS 1.3 has no renegotiation, updating the keys is what's left of it
+	if ((SSL_version(mSession) >= TLS1_3_VERSION ? SSL_key_update(mSession, SSL_KEY_UPDATE_REQUESTED) : SSL_renegotiate(mSession)) != 1)
+		throwSSLError("Can't start a new handshake");
+	handshake();
+}
+
+void TLSSocket::requestRenegotiate(std::string_view certificateStore, std::string_view certificateSubject)
+{
+	std::string store(certificateStore), subject(certificateSubject);
+
+	if (!mContextEstablished)
+		throw SocketException("A security context must be established before a new handshake can be performed");
+
+	ERR_clear_error();
+	if (SSL_use_certificate_chain_file(mSession, store.c_str()) != 1 || SSL_use_PrivateKey_file(mSession, subject.c_str(), SSL_FILETYPE_PEM) != 1 || SSL_check_private_key(mSession) != 1)
+		throwSSLError("Can't load the new certificate");
+	mCertificateStore = std::move(store);
+	mCertificateSubject = std::move(subject);
+	requestRenegotiate();
+}
+
+std::size_t TLSSocket::getMaxTLSMessageSize()
+{
+	if (mContextEstablished)
+		return SSL3_RT_HEADER_LENGTH + SSL3_RT_MAX_PLAIN_LENGTH + SSL3_RT_MAX_ENCRYPTED_OVERHEAD;
+	else
+		throw SocketException("A security context must be established before this method can be called");
+}
+
+void TLSSocket::shutdownConnection()
+{
+	int result;
+
+	if (!mContextEstablished)
+		throw SocketException("A security context must be established before it can be shut down");
+
+	ERR_clear_error();
+	result = SSL_shutdown(mSession);
+	if (result < 0)
+		throwIOError(mSession, result);
+}
+#endif
+
+void TLSSocket::setApplicationProtocols(std::span<const std::string_view> protocols)
+{
+	std::string wireFormat;
+
+	for (std::string_view protocol : protocols)
+	{
+		if (protocol.empty() || protocol.size() > 255)
+			throw std::invalid_argument("ALPN protocol names are 1 to 255 bytes long");
+		wireFormat += static_cast<char>(protocol.size());
+		wireFormat += protocol;
+	}
+
+	mApplicationProtocols = std::move(wireFormat);
+}
+
+bool TLSSocket::hasKernelOffload() const noexcept
+{
+	#ifdef _WIN32
+	return false;
+	#elif defined(__linux__)
+	return mSession && BIO_get_ktls_send(SSL_get_wbio(mSession));
+	#endif
+}
+
+std::size_t TLSSocket::getRecordSize(std::size_t maxRecordSize) noexcept
+{
+	auto now = std::chrono::steady_clock::now();
+
+	if (now - mLastSend >= idleRecordReset)
+		mSentSinceIdle = 0;
+	mLastSend = now;
+
+	return mSentSinceIdle < smallRecordBytes ? std::min(smallRecordSize, maxRecordSize) : maxRecordSize;
+}
+
+void TLSSocket::releaseBuffers() noexcept
+{
+	#ifdef _WIN32
+	mRecordBuffer.reset();
+	if (!hasBufferedData())
+	{
+		mReceiveBuffer.reset();
+		mCipherBegin = mCipherEnd = 0;
+	}
+	#elif defined(__linux__)
+	if (BIO *records = mSession ? SSL_get_wbio(mSession) : nullptr; records && BIO_method_type(records) == BIO_TYPE_BUFFER)
+	{
+		BIO *socket = BIO_next(records);
+
+		//every send flushes, nothing is left in it
+		BIO_up_ref(socket);
+		SSL_set0_wbio(mSession, socket);
+	}
+	if (mSession)
+		mSessionBuffers = SSL_free_buffers(mSession) != 1; //keeps them if a record is partly received
+	#endif
+}
+
+std::size_t TLSSocket::getBufferBytes() const noexcept
+{
+	#ifdef _WIN32
+	std::size_t recordBytes = static_cast<std::size_t>(mStreamSizes.cbHeader) + mStreamSizes.cbMaximumMessage + mStreamSizes.cbTrailer;
+
+	return (mRecordBuffer ? recordsPerWrite * recordBytes : 0) + (mReceiveBuffer ? getReceiveCapacity() : 0);
+	#elif defined(__linux__)
+	//OpenSSL doesn't say what it holds, this is what it's configured to allocate: the read ahead buffer and a record to write
+	std::size_t bytes = mSessionBuffers ? (recordsPerRead + 1) * SSL3_RT_MAX_PACKET_SIZE : 0;
+
+	if (mSession && BIO_method_type(SSL_get_wbio(mSession)) == BIO_TYPE_BUFFER)
+		bytes += recordsPerWrite * SSL3_RT_MAX_PACKET_SIZE;
+
+	return bytes;
+	#endif
+}
+
+bool TLSSocket::isEstablished() const noexcept
+{
+	return mContextEstablished;
+}
+
+bool TLSSocket::hasBufferedData() const noexcept
+{
+	#ifdef _WIN32
+	return mPlaintextSize || mCipherBegin != mCipherEnd || !mExtraData.empty();
+	#elif defined(__linux__)
+	return mSession && SSL_has_pending(mSession); //counts what read ahead received too
+	#endif
+}
+
+bool TLSSocket::isResumed() const noexcept
+{
+	#ifdef _WIN32
+	return false;
+	#elif defined(__linux__)
+	return mSession && SSL_session_reused(mSession);
+	#endif
+}
+
+std::string_view TLSSocket::getApplicationProtocol() const noexcept
+{
+	#ifdef _WIN32
+	return {};
+	#elif defined(__linux__)
+	const unsigned char *protocol = nullptr;
+	unsigned int length = 0;
+
+	if (mSession)
+		SSL_get0_alpn_selected(mSession, &protocol, &length);
+
+	return std::string_view(reinterpret_cast<const char*>(protocol), length);
+	#endif
+}
 
 //-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
@@ -8,6 +8,9 @@
 #include <variant>
 #include <optional>
 #include <span>
+#include <string>
+#include <string_view>
+#include <chrono>
 
 #ifdef _WIN32
 #define SECURITY_WIN32
@@ -18,9 +21,12 @@ using PollFileDescriptor = WSAPOLLFD;
 using DescriptorType = SOCKET;
 #elif defined __linux__
 #include <poll.h>
+#include <netdb.h>
+#include <openssl/ssl.h>
 using PollFileDescriptor = pollfd;
 using DescriptorType = int;
 #endif
+#include "File.h"
 
 class SocketException : public std::runtime_error
 {
@@ -83,12 +89,12 @@ protected:
 private:
 	int mDomain, mType, mProtocol;
 	bool mNonBlocking = false;
+	bool mNoDelay = false;
 
 	std::unique_ptr<addrinfo, decltype(freeaddrinfo)*> getAddressInfo(std::string_view address, std::uint16_t port, int flags);
-protected:
-	//Must be used with sockets returned from accept
-	Socket(DescriptorType);
 public:
+	//takes ownership of an open socket, one returned from accept or a listener inherited from another process
+	explicit Socket(DescriptorType);
 	Socket(int domain, int type, int protocol);
 	Socket(const Socket&) = delete;
 	Socket(Socket&&) noexcept;
@@ -103,43 +109,115 @@ public:
 	void toggleNonBlockingMode(bool toggle);
 	bool isNonBlocking();
 	void setSocketOption(int level, int optionName, const void *optionValue, int optionLength);
+	void setNoDelay(bool toggle);
+	//while corked, partial segments are held back so headers and the first body bytes leave together
+	void setCork(bool toggle);
+	//CPU that processed the last packets received on this socket, nullopt if the system can't tell
+	std::optional<unsigned> getIncomingCpu() const noexcept;
 	virtual Socket* accept();
+	//like accept, for callers that construct the socket object themselves
+	DescriptorType acceptDescriptor();
 	virtual std::string receive(int flags = 0);
 	virtual std::int64_t receive(void *buffer, size_t bufferSize, int flags = 0);
 	virtual std::int64_t send(const void *buffer, size_t bufferSize, int flags = 0);
+	//sends count bytes of file starting at offset without copying them to user space
+	virtual std::uint64_t sendFile(const File &file, std::uint64_t offset, std::uint64_t count);
+	//true if the socket holds received bytes that polling the descriptor won't report
+	virtual bool hasBufferedData() const noexcept;
 	DescriptorType get() const noexcept;
 };
 
+class TLSContext;
+
 class TLSSocket : public Socket
 {
+	friend class TLSContext; //its ALPN callback reads mApplicationProtocols
 public:
 	enum class Role { CLIENT, SERVER };
+	enum class HandshakeStatus { Complete, WantRead, WantWrite };
 private:
 	std::string mCertificateStore, mCertificateSubject, mExtraData;
 	std::optional<std::string> mPrincipalName;
-	CredHandle mCredentialsHandle = {};
-	SecHandle mContextHandle = {};
-	SecPkgContext_StreamSizes mStreamSizes = {};
+	std::string mApplicationProtocols; //ALPN wire format, each name prefixed by its length
 	Role mRole;
 	bool mContextEstablished = false;
+	std::shared_ptr<const TLSContext> mContext; //created from the certificate names on the first handshake if none was given
+	std::size_t mSentSinceIdle = 0; //decides the record size, see getRecordSize
+	std::chrono::steady_clock::time_point mLastSend;
+
+	//small records while the connection's congestion window is small, at its start or after it was idle, full size ones after that
+	std::size_t getRecordSize(std::size_t maxRecordSize) noexcept;
+	#ifdef _WIN32
+	SecHandle mContextHandle = {};
+	SecPkgContext_StreamSizes mStreamSizes = {};
+	std::unique_ptr<std::byte[]> mRecordBuffer; //records are encrypted in place one after another and sent together, see releaseBuffers
+	std::unique_ptr<std::byte[]> mReceiveBuffer; //records as they were received, decrypted where they are
+	std::size_t mPlaintextBegin = 0, mPlaintextSize = 0; //in mReceiveBuffer, decrypted but not returned yet
+	std::size_t mCipherBegin = 0, mCipherEnd = 0; //in mReceiveBuffer, received but not decrypted yet
+
+	std::string mHandshakeInput, mHandshakeOutput; //of continueHandshake, received tokens not processed yet and tokens not sent yet
+	bool mHandshakeIncomplete = false; //mHandshakeInput ends with part of a message
+	bool mHandshakeFinished = false; //the context is complete once mHandshakeOutput is sent
 
-	CredHandle acquireCredentials(std::string_view certificateStore, std::string_view certificateSubject) const;
 	unsigned long getContextAttributes() const noexcept;
+	std::size_t getReceiveCapacity() const noexcept;
+	//appends to the ciphertext in mReceiveBuffer, from mExtraData or with one recv of whatever has arrived. Only while no plaintext is left.
+	void fillReceiveBuffer();
+	//decrypts the first buffered record in place, false if it isn't complete yet
+	bool decryptRecord();
 	std::string negotiate(CredHandle&, SecHandle&, std::optional<std::span<std::byte>>);
-	TLSSocket(DescriptorType, std::string_view certificateStore, std::string_view certificateSubject, Role role = Role::SERVER, const std::optional<std::string> &principalName = std::optional<std::string>());
+	#elif defined(__linux__)
+	SSL *mSession = nullptr;
+	std::size_t mRecordSize = 0; //the session's maximum fragment length
+	bool mSessionBuffers = false; //OpenSSL may hold its read and write buffers, from the first read or write until releaseBuffers frees them
+
+	void createSession();
+	HandshakeStatus handshakeStep();
+	//runs SSL_do_handshake to completion on the socket in non-blocking mode, waiting with poll up to the receive timeout
+	void handshake();
+	#endif
 public:
+	//certificateStore and certificateSubject name a system store and a certificate subject with Schannel. On Linux they're the paths
+	//of PEM files with the certificate chain and its private key, clients can leave them empty.
+	//Takes ownership of an open socket, see Socket(DescriptorType).
+	TLSSocket(Socket &&socket, std::string_view certificateStore, std::string_view certificateSubject, Role role = Role::SERVER, const std::optional<std::string> &principalName = std::optional<std::string>());
 	TLSSocket(int domain, std::string_view certificateStore, std::string_view certificateSubject, Role role = Role::SERVER, const std::optional<std::string> &principalName = std::optional<std::string>());
+	//handshakes with the credentials of context, and for servers resumes the sessions it holds. The role is the context's.
+	TLSSocket(Socket &&socket, std::shared_ptr<const TLSContext> context, const std::optional<std::string> &principalName = std::optional<std::string>());
 	TLSSocket(TLSSocket&&) noexcept;
 	~TLSSocket() override;
 	TLSSocket& operator=(TLSSocket&&) noexcept;
 
+	//accepted sockets share this socket's context
 	TLSSocket* accept() override;
 	std::string receive(int flags = 0) override;
-	//Assumes buffer is big enough to hold a full TLS message
+	//returns what's left of the last record and then whole records that were already received, up to bufferSize. Only waits for
+	//the socket if none of that was there.
 	std::int64_t receive(void *buffer, size_t bufferSize, int flags = 0) override;
 	std::int64_t send(const void *buffer, size_t bufferSize, int flags = 0) override;
+	//file contents go through user space to be encrypted, unless the kernel does it, see hasKernelOffload
+	std::uint64_t sendFile(const File &file, std::uint64_t offset, std::uint64_t count) override;
 
+	//runs the whole handshake, blocking up to the receive timeout
 	void establishSecurityContext();
+	//as much of the handshake as can be done without waiting, for sockets in non-blocking mode. Call again once the socket is readable
+	//or writable, as the result says, until it's Complete. Lets an event loop drive many handshakes without a thread waiting on each.
+	HandshakeStatus continueHandshake();
+	bool isEstablished() const noexcept;
+	bool hasBufferedData() const noexcept override;
+	//frees the buffers sends and receives reuse, for connections that will be idle for a while. They're allocated again when needed.
+	void releaseBuffers() noexcept;
+	//held by the buffers releaseBuffers frees, for memory accounting
+	std::size_t getBufferBytes() const noexcept;
+	//ALPN names in order of preference, servers offer {"http/1.1"} unless told otherwise. Takes effect on the next handshake.
+	//Not negotiated by the Schannel implementation yet.
+	void setApplicationProtocols(std::span<const std::string_view> protocols);
+	//true once the kernel encrypts what's sent (kTLS), so sendFile doesn't copy the file. Linux only.
+	bool hasKernelOffload() const noexcept;
+	//true if the handshake resumed an earlier session instead of doing a full one. Linux only, false elsewhere.
+	bool isResumed() const noexcept;
+	//the protocol agreed on in the handshake, empty if there was none
+	std::string_view getApplicationProtocol() const noexcept;
 	void requestRenegotiate();
 	void requestRenegotiate(std::string_view certificateStore, std::string_view certificateSubject);
 	std::size_t getMaxTLSMessageSize();
@@ -0,0 +1,324 @@
+#include "TLSContext.h"
+#include <memory>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <cstring>
+#include <new>
+
+#ifdef _WIN32
+#include <Schnlsp.h>
+#elif defined(__linux__)
+#include <openssl/err.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <openssl/core_names.h>
+#endif
+
+namespace
+{
+	#ifdef _WIN32
+	void checkSSPIReturn(SECURITY_STATUS ret)
+	{
+		if (ret < 0)
+			throw SocketException(ret);
+	}
+	#elif defined(__linux__)
+	[[noreturn]] void throwSSLError(const std::string &what)
+	{
+		char description[256] = {};
+
+		ERR_error_string_n(ERR_get_error(), description, sizeof(description));
+		ERR_clear_error();
+		throw SocketException(what + ": " + description);
+	}
+
+	constexpr unsigned char sessionIdContext[] = "HTTPCPP"; //sessions are only resumed by contexts with the same one
+	#endif
+}
+
+#ifdef _WIN32
+TLSContext::TLSContext(std::string_view certificateStore, std::string_view certificateSubject, TLSSocket::Role role, const TLSSessionConfiguration &configuration)
+	:mRole(role)
+	,mConfiguration(configuration)
+{
+	using std::unique_ptr;
+	using std::remove_pointer;
+	unique_ptr<remove_pointer<HCERTSTORE>::type, std::function<BOOL __stdcall(HCERTSTORE)>> certificateStorePointer(nullptr, std::bind(CertCloseStore, std::placeholders::_1, CERT_CLOSE_STORE_FORCE_FLAG));
+	unique_ptr<const CERT_CONTEXT, decltype(CertFreeCertificateContext) *> certificate(nullptr, CertFreeCertificateContext);
+	std::string store(certificateStore), subject(certificateSubject);
+
+	certificateStorePointer.reset(CertOpenSystemStoreA(NULL, store.c_str()));
+	if (!certificateStorePointer)
+		throw SocketException(GetLastError());
+
+	certificate.reset(CertFindCertificateInStore(certificateStorePointer.get(), X509_ASN_ENCODING | PKCS_7_ASN_ENCODING, 0, CERT_FIND_SUBJECT_STR_A, subject.c_str(), NULL));
+	if (!certificate)
+		throw SocketException(GetLastError());
+
+	auto certPtr = certificate.get();
+	//Schannel caches the sessions of a credentials handle and issues tickets for them by itself, sharing the handle is what lets them resume
+	SCHANNEL_CRED schannelCredential = { .dwVersion = SCHANNEL_CRED_VERSION, .cCreds = 1, .paCred = &certPtr, .dwSessionLifespan = static_cast<DWORD>(std::chrono::duration_cast<std::chrono::milliseconds>(configuration.mLifetime).count()) };
+
+	checkSSPIReturn(AcquireCredentialsHandleA(nullptr, const_cast<char *>("Schannel"), role == TLSSocket::Role::SERVER ? SECPKG_CRED_INBOUND : SECPKG_CRED_OUTBOUND, nullptr, &schannelCredential, nullptr, nullptr, &mCredentials, nullptr));
+}
+
+TLSContext::~TLSContext()
+{
+	FreeCredentialsHandle(&mCredentials);
+}
+
+void TLSContext::rotateTicketKeys()
+{}
+
+CredHandle* TLSContext::getCredentials() const noexcept
+{
+	return &mCredentials;
+}
+
+#elif defined(__linux__)
+TLSContext::TLSContext(std::string_view certificateStore, std::string_view certificateSubject, TLSSocket::Role role, const TLSSessionConfiguration &configuration)
+	:mRole(role)
+	,mConfiguration(configuration)
+	,mContext(SSL_CTX_new(role == TLSSocket::Role::SERVER ? TLS_server_method() : TLS_client_method()))
+{
+	std::string store(certificateStore), subject(certificateSubject);
+
+	if (!mContext)
+		throwSSLError("Can't create a TLS context");
+
+	try
+	{
+		SSL_CTX_set_min_proto_version(mContext, TLS1_2_VERSION);
+		//with the kernel's tls module loaded and a cipher it implements, records are encrypted and decrypted in the kernel after the handshake
+		SSL_CTX_set_options(mContext, SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_ENABLE_KTLS);
+
+		if (!store.empty() && SSL_CTX_use_certificate_chain_file(mContext, store.c_str()) != 1)
+			throwSSLError("Can't load the certificate chain from " + store);
+		if (!subject.empty() && (SSL_CTX_use_PrivateKey_file(mContext, subject.c_str(), SSL_FILETYPE_PEM) != 1 || SSL_CTX_check_private_key(mContext) != 1))
+			throwSSLError("Can't load the private key from " + subject);
+
+		if (role == TLSSocket::Role::SERVER)
+		{
+			SSL_CTX_set_alpn_select_cb(mContext, [](SSL *session, const unsigned char **selected, unsigned char *selectedLength, const unsigned char *offered, unsigned int offeredLength, void*) -> int
+			{
+				const std::string &supported = static_cast<const TLSSocket*>(SSL_get_app_data(session))->mApplicationProtocols;
+
+				//the server's preference wins, clients that share none of its protocols get no ALPN extension back
+				if (SSL_select_next_proto(const_cast<unsigned char**>(selected), selectedLength, reinterpret_cast<const unsigned char*>(supported.data()), static_cast<unsigned int>(supported.size()), offered, offeredLength) != OPENSSL_NPN_NEGOTIATED)
+					return SSL_TLSEXT_ERR_NOACK;
+				return SSL_TLSEXT_ERR_OK;
+			}, nullptr);
+			configureSessions();
+		}
+		else if (SSL_CTX_set_default_verify_paths(mContext) != 1) //used by sockets that have a principal name to verify
+			throwSSLError("Can't load the trusted certificates");
+	}
+	catch (...)
+	{
+		SSL_CTX_free(mContext);
+		throw;
+	}
+}
+
+TLSContext::~TLSContext()
+{
+	for (Shard &shard : mShards)
+		for (CachedSession &entry : shard.mSessions)
+			SSL_SESSION_free(entry.mSession);
+	SSL_CTX_free(mContext);
+}
+
+void TLSContext::configureSessions()
+{
+	SSL_CTX_set_app_data(mContext, this);
+	SSL_CTX_set_timeout(mContext, static_cast<long>(mConfiguration.mLifetime.count()));
+	if (SSL_CTX_set_session_id_context(mContext, sessionIdContext, sizeof(sessionIdContext) - 1) != 1)
+		throwSSLError("Can't set the session id context");
+
+	if (mConfiguration.mCacheSize)
+	{
+		//OpenSSL's own cache is one table behind one lock, handshakes would queue on it
+		SSL_CTX_set_session_cache_mode(mContext, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+		SSL_CTX_sess_set_new_cb(mContext, [](SSL *session, SSL_SESSION *established) -> int
+		{
+			try
+			{
+				static_cast<TLSContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(session)))->storeSession(established);
+				return 1; //the cache keeps the reference it was given
+			}
+			catch (const std::bad_alloc&)
+			{
+				return 0; //not cached, the client resumes with a ticket or not at all
+			}
+		});
+		SSL_CTX_sess_set_get_cb(mContext, [](SSL *session, const unsigned char *id, int idLength, int *copy) -> SSL_SESSION*
+		{
+			*copy = 1; //OpenSSL takes a reference of its own
+			return static_cast<TLSContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(session)))->findSession(std::string_view(reinterpret_cast<const char*>(id), static_cast<std::size_t>(idLength)));
+		});
+		SSL_CTX_sess_set_remove_cb(mContext, [](SSL_CTX *context, SSL_SESSION *session)
+		{
+			static_cast<TLSContext*>(SSL_CTX_get_app_data(context))->removeSession(session);
+		});
+	}
+	else
+		SSL_CTX_set_session_cache_mode(mContext, SSL_SESS_CACHE_OFF);
+
+	if (mConfiguration.mTickets)
+	{
+		rotateTicketKeys();
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(mContext, [](SSL *session, unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, int encrypt) -> int
+		{
+			return static_cast<TLSContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(session)))->initializeTicketCipher(name, iv, cipher, mac, encrypt);
+		});
+	}
+	else
+		SSL_CTX_set_options(mContext, SSL_OP_NO_TICKET); //TLS 1.3 resumes from the cache then too
+}
+
+TLSContext::Shard& TLSContext::getShard(std::string_view id) noexcept
+{
+	//session ids are random, any of their bytes spreads them evenly
+	return mShards[std::hash<std::string_view>()(id) % shardCount];
+}
+
+void TLSContext::storeSession(SSL_SESSION *session)
+{
+	unsigned int idLength;
+	const unsigned char *id = SSL_SESSION_get_id(session, &idLength);
+	CachedSession entry = { std::string(reinterpret_cast<const char*>(id), idLength), session };
+	Shard &shard = getShard(entry.mId);
+	std::size_t capacity = std::max<std::size_t>(mConfiguration.mCacheSize / shardCount, 1);
+	SSL_SESSION *evicted = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lck(shard.mMutex);
+
+		if (shard.mIndex.contains(entry.mId))
+		{
+			SSL_SESSION_free(session);
+			return;
+		}
+		if (shard.mSessions.size() >= capacity)
+		{
+			evicted = shard.mSessions.front().mSession;
+			shard.mIndex.erase(shard.mSessions.front().mId);
+			shard.mSessions.pop_front();
+		}
+		shard.mSessions.push_back(std::move(entry));
+		shard.mIndex.emplace(shard.mSessions.back().mId, std::prev(shard.mSessions.end()));
+	}
+
+	SSL_SESSION_free(evicted); //outside the lock, freeing isn't free
+}
+
+SSL_SESSION* TLSContext::findSession(std::string_view id)
+{
+	Shard &shard = getShard(id);
+	std::lock_guard<std::mutex> lck(shard.mMutex);
+	auto found = shard.mIndex.find(id);
+
+	//expired sessions are rejected and removed by OpenSSL
+	return found == shard.mIndex.end() ? nullptr : found->second->mSession;
+}
+
+void TLSContext::removeSession(SSL_SESSION *session) noexcept
+{
+	unsigned int idLength;
+	const unsigned char *id = SSL_SESSION_get_id(session, &idLength);
+	std::string_view key(reinterpret_cast<const char*>(id), idLength);
+	Shard &shard = getShard(key);
+	SSL_SESSION *removed = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lck(shard.mMutex);
+
+		if (auto found = shard.mIndex.find(key); found != shard.mIndex.end())
+		{
+			auto entry = found->second;
+
+			removed = entry->mSession;
+			shard.mIndex.erase(found);
+			shard.mSessions.erase(entry);
+		}
+	}
+
+	SSL_SESSION_free(removed);
+}
+
+void TLSContext::rotateTicketKeys()
+{
+	using namespace std::chrono;
+	TicketKey key;
+	//enough old keys to decrypt every ticket that hasn't expired yet
+	std::size_t kept = 1 + static_cast<std::size_t>((mConfiguration.mLifetime + mConfiguration.mTicketKeyRotation - seconds(1)) / std::max(mConfiguration.mTicketKeyRotation, seconds(1)));
+
+	if (RAND_bytes(key.mName, sizeof(key.mName)) != 1 || RAND_priv_bytes(key.mCipherKey, sizeof(key.mCipherKey)) != 1 || RAND_priv_bytes(key.mMacKey, sizeof(key.mMacKey)) != 1)
+		throwSSLError("Can't generate a session ticket key");
+
+	std::unique_lock<std::shared_mutex> lck(mTicketKeyMutex);
+
+	mTicketKeys.push_front(key);
+	if (mTicketKeys.size() > kept)
+		mTicketKeys.resize(kept);
+	mNextRotation.store((steady_clock::now() + mConfiguration.mTicketKeyRotation).time_since_epoch().count(), std::memory_order_relaxed);
+	std::memset(&key, 0, sizeof(key));
+}
+
+int TLSContext::initializeTicketCipher(unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, bool encrypt)
+{
+	OSSL_PARAM digest[] = { OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, const_cast<char*>("SHA256"), 0), OSSL_PARAM_construct_end() };
+
+	if (encrypt)
+	{
+		auto now = std::chrono::steady_clock::now();
+		auto next = mNextRotation.load(std::memory_order_relaxed);
+
+		//one of the handshakes that find the key expired replaces it, the others go on with the old one
+		if (now.time_since_epoch().count() >= next && mNextRotation.compare_exchange_strong(next, (now + mConfiguration.mTicketKeyRotation).time_since_epoch().count(), std::memory_order_relaxed))
+		{
+			try
+			{
+				rotateTicketKeys();
+			}
+			catch (const SocketException&)
+			{
+				return -1;
+			}
+		}
+
+		std::shared_lock<std::shared_mutex> lck(mTicketKeyMutex);
+		const TicketKey &key = mTicketKeys.front();
+
+		if (RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) != 1)
+			return -1;
+		std::memcpy(name, key.mName, sizeof(key.mName));
+		if (EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.mCipherKey, iv) != 1 || EVP_MAC_init(mac, key.mMacKey, sizeof(key.mMacKey), digest) != 1)
+			return -1;
+
+		return 1;
+	}
+
+	std::shared_lock<std::shared_mutex> lck(mTicketKeyMutex);
+	auto key = std::find_if(mTicketKeys.begin(), mTicketKeys.end(), [name](const TicketKey &key) { return !std::memcmp(key.mName, name, sizeof(key.mName)); });
+
+	if (key == mTicketKeys.end())
+		return 0; //its key has expired, a full handshake follows
+	if (EVP_MAC_init(mac, key->mMacKey, sizeof(key->mMacKey), digest) != 1 || EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key->mCipherKey, iv) != 1)
+		return -1;
+
+	return key == mTicketKeys.begin() ? 1 : 2; //2 resumes and issues a new ticket under the current key
+}
+
+SSL_CTX* TLSContext::get() const noexcept
+{
+	return mContext;
+}
+
+#endif
+
+TLSSocket::Role TLSContext::getRole() const noexcept
+{
+	return mRole;
+}
@@ -0,0 +1,91 @@
+#ifndef __TLSCONTEXT__
+#define __TLSCONTEXT__
+#include <cstddef>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <mutex>
+#include <shared_mutex>
+#include <atomic>
+#include <array>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include "Socket.h"
+
+//how long servers keep sessions for clients that come back, and how
+struct TLSSessionConfiguration
+{
+	std::size_t mCacheSize = 20480; //sessions kept for resumption by id, 0 disables the cache
+	std::chrono::seconds mLifetime = std::chrono::hours(2); //of a session, cached or in a ticket
+	std::chrono::seconds mTicketKeyRotation = std::chrono::hours(1); //tickets are issued with a new key this often, old keys decrypt until mLifetime has passed
+	bool mTickets = true; //false resumes from the cache only
+};
+
+//The credentials every TLS connection of a listener shares, loaded once instead of on every handshake. Server contexts keep the
+//sessions they establish so returning clients resume with an abbreviated handshake, by session id from a sharded cache or from a
+//session ticket they hold, encrypted with keys that rotate. Thread safe, sockets keep a reference to the context they were created with.
+class TLSContext
+{
+	TLSSocket::Role mRole;
+	TLSSessionConfiguration mConfiguration;
+
+	#ifdef _WIN32
+	mutable CredHandle mCredentials = {};
+	#elif defined(__linux__)
+	static constexpr std::size_t shardCount = 16; //handshakes on different workers rarely wait for each other
+
+	struct CachedSession
+	{
+		std::string mId;
+		SSL_SESSION *mSession; //the cache holds a reference
+	};
+
+	//oldest first, the first ones are dropped when it's full
+	struct Shard
+	{
+		std::mutex mMutex;
+		std::list<CachedSession> mSessions;
+		std::unordered_map<std::string_view, std::list<CachedSession>::iterator> mIndex; //keys point into mSessions
+	};
+
+	struct TicketKey
+	{
+		unsigned char mName[16];
+		unsigned char mCipherKey[32]; //AES-256-CBC
+		unsigned char mMacKey[32]; //HMAC-SHA256
+	};
+
+	SSL_CTX *mContext;
+	std::array<Shard, shardCount> mShards;
+	std::shared_mutex mTicketKeyMutex;
+	std::deque<TicketKey> mTicketKeys; //newest first, it encrypts new tickets
+	std::atomic<std::chrono::steady_clock::rep> mNextRotation = 0;
+
+	Shard& getShard(std::string_view id) noexcept;
+	void storeSession(SSL_SESSION *session);
+	SSL_SESSION* findSession(std::string_view id);
+	void removeSession(SSL_SESSION *session) noexcept;
+	//returns what OpenSSL's ticket key callback expects
+	int initializeTicketCipher(unsigned char *name, unsigned char *iv, EVP_CIPHER_CTX *cipher, EVP_MAC_CTX *mac, bool encrypt);
+	void configureSessions();
+	#endif
+public:
+	//certificateStore and certificateSubject as in TLSSocket's constructors
+	TLSContext(std::string_view certificateStore, std::string_view certificateSubject, TLSSocket::Role role = TLSSocket::Role::SERVER, const TLSSessionConfiguration &configuration = TLSSessionConfiguration());
+	TLSContext(const TLSContext&) = delete;
+	TLSContext& operator=(const TLSContext&) = delete;
+	~TLSContext();
+
+	TLSSocket::Role getRole() const noexcept;
+	//new tickets are encrypted with a fresh key from now on, for when a key might have leaked. Tickets issued before stay valid
+	//until their key expires. Does nothing with Schannel, which manages its own ticket keys.
+	void rotateTicketKeys();
+	#ifdef _WIN32
+	CredHandle* getCredentials() const noexcept;
+	#elif defined(__linux__)
+	SSL_CTX* get() const noexcept;
+	#endif
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __TASK__
+#define __TASK__
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//Move-only void() callable. Callables up to inlineSize bytes, like a lambda capturing a pointer and a shared_ptr,
+//are stored inside the object, so submitting a task neither allocates nor copies its captures.
+class Task
+{
+public:
+	static constexpr std::size_t inlineSize = 48;
+private:
+	struct Operations
+	{
+		void (*mInvoke)(void*);
+		void (*mMove)(void *destination, void *source) noexcept; //move constructs into destination and destroys source
+		void (*mDestroy)(void*) noexcept;
+	};
+
+	template<typename Callable>
+	static constexpr bool isInline = sizeof(Callable) <= inlineSize && alignof(Callable) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<Callable>;
+
+	template<typename Callable>
+	static constexpr Operations inlineOperations = {
+		[](void *storage) { (*std::launder(static_cast<Callable*>(storage)))(); },
+		[](void *destination, void *source) noexcept
+		{
+			Callable *callable = std::launder(static_cast<Callable*>(source));
+
+			::new (destination) Callable(std::move(*callable));
+			callable->~Callable();
+		},
+		[](void *storage) noexcept { std::launder(static_cast<Callable*>(storage))->~Callable(); }
+	};
+
+	template<typename Callable>
+	static constexpr Operations heapOperations = {
+		[](void *storage) { (**static_cast<Callable**>(storage))(); },
+		[](void *destination, void *source) noexcept { *static_cast<Callable**>(destination) = *static_cast<Callable**>(source); },
+		[](void *storage) noexcept { delete *static_cast<Callable**>(storage); }
+	};
+
+	alignas(std::max_align_t) unsigned char mStorage[inlineSize];
+	const Operations *mOperations = nullptr;
+public:
+	Task() noexcept = default;
+
+	template<typename Callable> requires (!std::is_same_v<std::decay_t<Callable>, Task> && std::is_invocable_v<std::decay_t<Callable>&>)
+	Task(Callable &&callable)
+	{
+		using Stored = std::decay_t<Callable>;
+
+		if constexpr (isInline<Stored>)
+		{
+			::new (static_cast<void*>(mStorage)) Stored(std::forward<Callable>(callable));
+			mOperations = &inlineOperations<Stored>;
+		}
+		else
+		{
+			*reinterpret_cast<Stored**>(mStorage) = new Stored(std::forward<Callable>(callable));
+			mOperations = &heapOperations<Stored>;
+		}
+	}
+
+	Task(Task &&other) noexcept
+		:mOperations(std::exchange(other.mOperations, nullptr))
+	{
+		if (mOperations)
+			mOperations->mMove(mStorage, other.mStorage);
+	}
+
+	Task& operator=(Task &&other) noexcept
+	{
+		if (this != &other)
+		{
+			reset();
+			mOperations = std::exchange(other.mOperations, nullptr);
+			if (mOperations)
+				mOperations->mMove(mStorage, other.mStorage);
+		}
+
+		return *this;
+	}
+
+	Task(const Task&) = delete;
+	Task& operator=(const Task&) = delete;
+
+	~Task()
+	{
+		reset();
+	}
+
+	void reset() noexcept
+	{
+		if (mOperations)
+			std::exchange(mOperations, nullptr)->mDestroy(mStorage);
+	}
+
+	explicit operator bool() const noexcept
+	{
+		return mOperations;
+	}
+
+	void operator()()
+	{
+		mOperations->mInvoke(mStorage);
+	}
+};
+
+#endif
@@ -3,92 +3,314 @@
 #include <mutex>
 #include <atomic>
 #include <vector>
-#include <tuple>
-#include <condition_variable>
-#include <queue>
-#include <functional>
+#include <deque>
+#include <optional>
+#include <cstdint>
+#include <latch>
+
+#ifdef _WIN32
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace
+{
+	constexpr std::size_t cacheLineSize = 64;
+
+	bool pinCurrentThread(unsigned cpu)
+	{
+		#ifdef _WIN32
+		GROUP_AFFINITY affinity = {};
+
+		affinity.Group = static_cast<WORD>(cpu / 64);
+		affinity.Mask = KAFFINITY(1) << (cpu % 64);
+		return SetThreadGroupAffinity(GetCurrentThread(), &affinity, nullptr);
+		#elif defined(__linux__)
+		cpu_set_t set;
+
+		if (cpu >= CPU_SETSIZE)
+			return false;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		return !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		#endif
+	}
+
+	//Dmitry Vyukov's bounded multi-producer multi-consumer queue. Each cell carries a sequence number that tells
+	//producers and consumers whose turn it is, so both sides only contend on a compare and swap of their own index.
+	//A pop on an empty queue is a single load, which keeps idle workers looking for work off everyone's cache lines.
+	template<typename T>
+	class BoundedQueue
+	{
+		struct Cell
+		{
+			std::atomic<std::size_t> mSequence;
+			std::optional<T> mValue;
+		};
+
+		std::vector<Cell> mCells;
+		const std::size_t mMask;
+		alignas(cacheLineSize) std::atomic<std::size_t> mEnqueuePosition = 0;
+		alignas(cacheLineSize) std::atomic<std::size_t> mDequeuePosition = 0;
+	public:
+		//capacity must be a power of two
+		BoundedQueue(std::size_t capacity)
+			:mCells(capacity),
+			mMask(capacity - 1)
+		{
+			for (std::size_t i = 0; i < capacity; ++i)
+				mCells[i].mSequence.store(i, std::memory_order_relaxed);
+		}
+
+		//false if the queue is full, value is left untouched then
+		bool tryPush(T &value)
+		{
+			std::size_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+			Cell *cell;
+
+			while (true)
+			{
+				cell = &mCells[position & mMask];
+				std::intptr_t difference = static_cast<std::intptr_t>(cell->mSequence.load(std::memory_order_acquire)) - static_cast<std::intptr_t>(position);
+
+				if (!difference)
+				{
+					if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+					return false;
+				else
+					position = mEnqueuePosition.load(std::memory_order_relaxed);
+			}
+
+			cell->mValue.emplace(std::move(value));
+			cell->mSequence.store(position + 1, std::memory_order_release);
+
+			return true;
+		}
+
+		bool tryPop(T &value)
+		{
+			std::size_t position = mDequeuePosition.load(std::memory_order_relaxed);
+			Cell *cell;
+
+			while (true)
+			{
+				cell = &mCells[position & mMask];
+				std::intptr_t difference = static_cast<std::intptr_t>(cell->mSequence.load(std::memory_order_acquire)) - static_cast<std::intptr_t>(position + 1);
+
+				if (!difference)
+				{
+					if (mDequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						break;
+				}
+				else if (difference < 0)
+					return false;
+				else
+					position = mDequeuePosition.load(std::memory_order_relaxed);
+			}
+
+			value = std::move(*cell->mValue);
+			cell->mValue.reset();
+			cell->mSequence.store(position + mMask + 1, std::memory_order_release);
+
+			return true;
+		}
+	};
+}
 
 class ThreadPool::Impl
 {
+	//Tasks submitted from inside one of this worker's tasks, and connections routed to the worker's CPU. The owner and thieves
+	//pop from the same end, so accepted connections are served in the order they came in, and nobody takes a lock to do it.
+	//A Chase-Lev deque would let the owner pop the newest task, but its thieves read a slot before they claim it, which only
+	//works for tasks that can be copied byte by byte. Task's inline callables can't, short of allocating every task again.
+	struct alignas(cacheLineSize) Worker
+	{
+		BoundedQueue<Task> mTasks;
+
+		Worker();
+	};
+
+	static constexpr std::size_t injectionCapacity = 4096;
+	static constexpr std::size_t workerCapacity = 1024; //what doesn't fit goes to the shared queues
+	static constexpr int spinCount = 64;
+	static thread_local Impl *currentPool;
+	static thread_local Worker *currentWorker;
+
 	std::atomic<bool> mWorkFlag;
-	std::vector<std::thread> mWorkers;
-	std::queue<std::function<TaskCallback>> mWorkQueue;
-	std::mutex mWorkMutex; //prevents data races in workStack
-	std::condition_variable mWorkAvailable, mNoWork;
-	unsigned mBusy;
+	std::vector<std::unique_ptr<Worker>> mWorkers; //allocated by each worker after it's pinned
+	std::vector<std::thread> mThreads;
+	std::vector<int> mCpuWorkers; //worker pinned to each CPU, -1 if there's none
+	std::latch mReady;
+	BoundedQueue<Task> mInjectionQueue;
+	std::mutex mOverflowMutex; //for bursts bigger than the injection queue
+	std::deque<Task> mOverflow;
+	std::atomic<std::size_t> mOverflowSize;
+	alignas(cacheLineSize) std::atomic<std::uint32_t> mWorkEpoch; //bumped on every submission, idle workers wait on it
+	std::atomic<unsigned> mSleeping;
+	alignas(cacheLineSize) std::atomic<std::size_t> mPending; //submitted and not finished yet
 
-	void workerProcedure();
+	bool tryGetTask(std::size_t index, Task &task);
+	void workerProcedure(std::size_t index, std::optional<unsigned> cpu);
 public:
-	Impl(std::size_t);
+	Impl(std::size_t, const std::vector<unsigned>&);
 	~Impl();
 
-	void addTask(const std::function<TaskCallback>&);
+	void addTask(Task task, std::optional<unsigned> cpu);
 	void waitForTasks();
 };
 
-void ThreadPool::Impl::workerProcedure()
+thread_local ThreadPool::Impl *ThreadPool::Impl::currentPool = nullptr;
+thread_local ThreadPool::Impl::Worker *ThreadPool::Impl::currentWorker = nullptr;
+
+ThreadPool::Impl::Worker::Worker()
+	:mTasks(workerCapacity)
+{}
+
+bool ThreadPool::Impl::tryGetTask(std::size_t index, Task &task)
 {
-	while (mWorkFlag.load())
+	if (mWorkers[index]->mTasks.tryPop(task) || mInjectionQueue.tryPop(task))
+		return true;
+
+	if (mOverflowSize.load(std::memory_order_acquire))
 	{
-		std::unique_lock<std::mutex> lck(mWorkMutex);
+		std::lock_guard<std::mutex> lck(mOverflowMutex);
 
-		if (!mWorkQueue.empty())
+		if (!mOverflow.empty())
 		{
-			auto task = mWorkQueue.front();
-			mWorkQueue.pop();
+			task = std::move(mOverflow.front());
+			mOverflow.pop_front();
+			mOverflowSize.store(mOverflow.size(), std::memory_order_release);
+			return true;
+		}
+	}
 
-			++mBusy;
-			lck.unlock();
-			task();
-			lck.lock();
-			--mBusy;
+	for (std::size_t i = 1; i < mWorkers.size(); ++i)
+	{
+		if (mWorkers[(index + i) % mWorkers.size()]->mTasks.tryPop(task))
+			return true;
+	}
 
-			if(mWorkQueue.empty())
-				mNoWork.notify_all();
+	return false;
+}
+
+void ThreadPool::Impl::workerProcedure(std::size_t index, std::optional<unsigned> cpu)
+{
+	Task task;
+
+	if (cpu)
+		pinCurrentThread(*cpu); //best effort, the CPU may be offline or outside of our cgroup
+	mWorkers[index] = std::make_unique<Worker>(); //first touch happens here, on the node the worker runs on
+	currentPool = this;
+	currentWorker = mWorkers[index].get();
+	mReady.arrive_and_wait(); //every worker has to exist before any of them starts stealing
+
+	while (mWorkFlag.load(std::memory_order_acquire))
+	{
+		//read before looking for work, so a submission that happens after the search changes it and the wait returns
+		std::uint32_t epoch = mWorkEpoch.load();
+		bool found = false;
+
+		for (int i = 0; i < spinCount && !found; ++i)
+		{
+			found = tryGetTask(index, task);
+			if (!found)
+				std::this_thread::yield();
 		}
-		else
-			mWorkAvailable.wait(lck, [this]() { return !mWorkQueue.empty() || !mWorkFlag.load(); });
+
+		if (!found)
+		{
+			mSleeping.fetch_add(1);
+			if (mWorkFlag.load(std::memory_order_acquire))
+				mWorkEpoch.wait(epoch);
+			mSleeping.fetch_sub(1);
+			continue;
+		}
+
+		task();
+		task.reset(); //captures are released before the worker goes idle
+
+		if (mPending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+			mPending.notify_all();
 	}
 }
 
-ThreadPool::Impl::Impl(std::size_t workerCount)
+ThreadPool::Impl::Impl(std::size_t workerCount, const std::vector<unsigned> &cpus)
 	:mWorkFlag(true)
-	,mBusy(0)
+	,mWorkers(workerCount)
+	,mReady(static_cast<std::ptrdiff_t>(workerCount + 1))
+	,mInjectionQueue(injectionCapacity)
+	,mOverflowSize(0)
+	,mWorkEpoch(0)
+	,mSleeping(0)
+	,mPending(0)
 {
 	for (size_t i = 0; i < workerCount; ++i)
 	{
-		auto newElem = mWorkers.emplace(mWorkers.end(), std::thread(&Impl::workerProcedure, this));
+		std::optional<unsigned> cpu;
+
+		if (!cpus.empty())
+		{
+			cpu = cpus[i % cpus.size()];
+			if (mCpuWorkers.size() <= *cpu)
+				mCpuWorkers.resize(*cpu + 1, -1);
+			if (mCpuWorkers[*cpu] == -1)
+				mCpuWorkers[*cpu] = static_cast<int>(i);
+		}
+
+		mThreads.emplace_back(&Impl::workerProcedure, this, i, cpu);
 	}
+
+	mReady.arrive_and_wait();
 }
 
 ThreadPool::Impl::~Impl()
 {
 	mWorkFlag.store(false);
-	mWorkAvailable.notify_all();
-	for (auto &workData : mWorkers) {
-		workData.join();
-	}
+	mWorkEpoch.fetch_add(1);
+	mWorkEpoch.notify_all();
+	for (auto &thread : mThreads)
+		thread.join();
 }
 
-void ThreadPool::Impl::addTask(const std::function<TaskCallback> &task)
+void ThreadPool::Impl::addTask(Task task, std::optional<unsigned> cpu)
 {
-	std::unique_lock<std::mutex>(workMutex);
-	mWorkQueue.emplace(task);
-	mWorkAvailable.notify_one();
+	Worker *target = currentPool == this ? currentWorker : nullptr; //submitted from one of our tasks, keep it local to this worker's cache
+
+	if (!target && cpu && *cpu < mCpuWorkers.size() && mCpuWorkers[*cpu] != -1)
+		target = mWorkers[mCpuWorkers[*cpu]].get();
+
+	mPending.fetch_add(1, std::memory_order_relaxed);
+
+	//a full queue spills over to the shared ones
+	if ((!target || !target->mTasks.tryPush(task)) && !mInjectionQueue.tryPush(task))
+	{
+		std::lock_guard<std::mutex> lck(mOverflowMutex);
+		mOverflow.push_back(std::move(task));
+		mOverflowSize.store(mOverflow.size(), std::memory_order_release);
+	}
+
+	mWorkEpoch.fetch_add(1);
+	if (mSleeping.load())
+		mWorkEpoch.notify_one();
 }
 
 void ThreadPool::Impl::waitForTasks()
 {
-	std::unique_lock<std::mutex> lck(mWorkMutex);
-	mNoWork.wait(lck, [this]() { return mWorkQueue.empty() && !mBusy; });
+	for (std::size_t pending = mPending.load(std::memory_order_acquire); pending; pending = mPending.load(std::memory_order_acquire))
+		mPending.wait(pending);
 }
 
 //-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 //-----------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------------
 
-ThreadPool::ThreadPool(size_t workerCount)
-	:mThis(new Impl(workerCount))
+ThreadPool::ThreadPool(size_t workerCount, const std::vector<unsigned> &cpus)
+	:mThis(new Impl(workerCount, cpus))
 {}
 
 ThreadPool::~ThreadPool() noexcept = default;
@@ -97,9 +319,9 @@ ThreadPool::ThreadPool(ThreadPool&&) noexcept = default;
 
 ThreadPool& ThreadPool::operator=(ThreadPool&&) noexcept = default;
 
-void ThreadPool::addTask(const std::function<TaskCallback> &callback)
+void ThreadPool::addTask(Task task, std::optional<unsigned> cpu)
 {
-	mThis->addTask(callback);
+	mThis->addTask(std::move(task), cpu);
 }
 
 void ThreadPool::waitForTasks()
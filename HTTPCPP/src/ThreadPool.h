@@ -1,23 +1,25 @@
 #ifndef __THREADPOOL__
 #define __THREADPOOL__
 #include <memory>
-#include <functional>
+#include <vector>
+#include <optional>
+#include "Task.h"
 
 class ThreadPool
 {
 	class Impl;
 	std::unique_ptr<Impl> mThis;
 public:
-	using TaskCallback = void();
-
-	ThreadPool(size_t workerCount);
+	//worker i is pinned to cpus[i % cpus.size()] before it allocates its own state, so that memory is local to the CPU's NUMA node
+	ThreadPool(size_t workerCount, const std::vector<unsigned> &cpus = {});
 	~ThreadPool() noexcept;
 	ThreadPool(const ThreadPool&) = delete;
 	ThreadPool& operator=(const ThreadPool&) = delete;
 	ThreadPool(ThreadPool&&) noexcept;
 	ThreadPool& operator=(ThreadPool&&) noexcept;
 
-	void addTask(const std::function<TaskCallback> &callback);
+	//cpu is a hint, the task is queued on a worker pinned to it if there's one. Idle workers may still steal it.
+	void addTask(Task task, std::optional<unsigned> cpu = std::nullopt);
 	//blocks until there are no more tasks
 	void waitForTasks();
 };
@@ -0,0 +1,78 @@
+#include "Wakeup.h"
+#include <cstdint>
+
+#ifdef _WIN32
+#include <ws2tcpip.h>
+#elif defined(__linux__)
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#ifdef _WIN32
+Wakeup::Wakeup()
+	:mSocket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)
+{
+	sockaddr_in address = {};
+	int addressLength = sizeof(address);
+
+	mSocket.bind("127.0.0.1", 0, true);
+	if (getsockname(mSocket.get(), reinterpret_cast<sockaddr*>(&address), &addressLength) == SOCKET_ERROR)
+		throw SocketException(WSAGetLastError());
+	mSocket.connect("127.0.0.1", ntohs(address.sin_port), true);
+	mSocket.toggleNonBlockingMode(true);
+}
+
+Wakeup::~Wakeup() = default;
+#elif defined(__linux__)
+Wakeup::Wakeup()
+	:mDescriptor(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+	if (mDescriptor == -1)
+		throw SocketException(errno);
+}
+
+Wakeup::~Wakeup()
+{
+	::close(mDescriptor);
+}
+#endif
+
+DescriptorType Wakeup::get() const noexcept
+{
+	#ifdef _WIN32
+	return mSocket.get();
+	#elif defined(__linux__)
+	return mDescriptor;
+	#endif
+}
+
+void Wakeup::notify() noexcept
+{
+	if (mPending.exchange(true, std::memory_order_acq_rel))
+		return;
+
+	#ifdef _WIN32
+	char c = 0;
+	::send(mSocket.get(), &c, 1, 0);
+	#elif defined(__linux__)
+	std::uint64_t value = 1;
+	[[maybe_unused]] auto written = ::write(mDescriptor, &value, sizeof(value));
+	#endif
+}
+
+void Wakeup::clear() noexcept
+{
+	//Drained first. Clearing mPending first would let a notify in between write and the drain swallow it, leaving mPending set
+	//with nothing to read, and every later notify would return early. A notify that sees mPending still set now is for
+	//something the poller looks at after clear returns anyway.
+	#ifdef _WIN32
+	char buffer[16];
+	while (::recv(mSocket.get(), buffer, sizeof(buffer), 0) > 0);
+	#elif defined(__linux__)
+	std::uint64_t value;
+	[[maybe_unused]] auto read = ::read(mDescriptor, &value, sizeof(value));
+	#endif
+
+	mPending.store(false, std::memory_order_release);
+}
@@ -0,0 +1,28 @@
+#ifndef __WAKEUP__
+#define __WAKEUP__
+#include <atomic>
+#include "Socket.h"
+
+//A descriptor that polls readable once notified, so other threads can interrupt the server thread's poll.
+//Notifications that arrive before the poller clears the previous one are merged into it and cost no system call.
+class Wakeup
+{
+	#ifdef _WIN32
+	Socket mSocket; //UDP socket connected to itself, WSAPoll only takes sockets
+	#elif defined(__linux__)
+	int mDescriptor; //eventfd
+	#endif
+	std::atomic<bool> mPending = false;
+public:
+	Wakeup();
+	Wakeup(const Wakeup&) = delete;
+	Wakeup& operator=(const Wakeup&) = delete;
+	~Wakeup();
+
+	DescriptorType get() const noexcept;
+	void notify() noexcept;
+	//called by the poller once the descriptor polls readable, before it looks at what it was woken up for
+	void clear() noexcept;
+};
+
+#endif